@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "project.h"
+#include "timer.h"
+#include "console.h"
+
+//
+// timer queue benchmark
+//
+//  built in place of main.c, see README.md, sweeps the number of live timer
+//  events and prints one CSV line per queue depth and deadline pattern
+//
+//    insert  - schedule_timer_event() of one more timer event
+//    cancel  - cancel_timer_event() of a live timer event
+//    expire  - the compare interrupt handler per timer event expired, with
+//              every live timer event due
+//    isr     - the longest compare interrupt handler pass
+//
+//  deadline patterns
+//
+//    random  - spread at random
+//    fifo    - each later than every timer event before it
+//    same    - one deadline for all
+//
+//  times are cpu cycles measured on the timebase timer, exact with
+//  TBTIMER_PRESCALER 1, and include the call but not the interrupt entry and
+//  exit, on the host simulator they come from its per basic block cost model
+//
+#ifndef BENCH_EVENTS
+// largest queue depth, TIMER_HEAP_SIZE must be at least this
+#define BENCH_EVENTS 128
+#endif
+
+#ifndef BENCH_REPEAT
+// measurements of insert and cancel at each queue depth
+#define BENCH_REPEAT 16
+#endif
+
+#if TBTIMER != 1
+#error "The benchmark measures with the 16-bit timer, set TBTIMER to 1."
+#endif
+
+#if (TIMER_QUEUE == TIMER_QUEUE_HEAP) && (TIMER_HEAP_SIZE < BENCH_EVENTS)
+#error "TIMER_HEAP_SIZE is less than BENCH_EVENTS."
+#endif
+
+//
+// deadlines of the insert and cancel measurements are spread over one second
+// starting one second out, none expire while they are measured
+//
+#define BENCH_HORIZON TBTICKS_FROM_MS(1000)
+
+//
+// deadlines of the expiry measurement are spread over 200us starting 50ms
+// out, interrupts are disabled from 1ms before the first until the last
+//
+#define BENCH_EXPIRE_LEAD TBTICKS_FROM_MS(50)
+#define BENCH_EXPIRE_SPREAD TBTICKS_FROM_US(200)
+#define BENCH_EXPIRE_GUARD TBTICKS_FROM_MS(1)
+
+#define BENCH_RANDOM 0
+#define BENCH_FIFO 1
+#define BENCH_SAME 2
+
+extern void timer1_init(void);
+extern void tbtimer_handler(void);
+
+static struct timer_event bench_event[BENCH_EVENTS];
+
+static uint32_t bench_seed;
+static tbtick_t bench_base;
+static tbtick_t bench_spread;
+static tbtick_t bench_fifo;
+static tbtimer_t bench_overhead;
+
+static const char * const bench_pattern_name[] = { "random", "fifo", "same" };
+
+#if TIMER_QUEUE == TIMER_QUEUE_WHEEL
+#define BENCH_QUEUE "wheel"
+#elif TIMER_QUEUE == TIMER_QUEUE_HEAP
+#define BENCH_QUEUE "heap"
+#elif TIMER_EVENT_PREV
+#define BENCH_QUEUE "list-prev"
+#else
+#define BENCH_QUEUE "list"
+#endif
+
+
+//
+// repeatable pseudo random numbers
+//
+static uint16_t bench_random(void)
+{
+    bench_seed = bench_seed * 1664525UL + 1013904223UL;
+
+    return (uint16_t) (bench_seed >> 16);
+}
+
+
+static int8_t bench_handler(struct timer_event * this_timer_event)
+{
+    return 0;
+}
+
+
+//
+// start a run of deadlines tbtick ticks from now spread over spread ticks
+//
+static void bench_deadlines(tbtick_t tbtick, tbtick_t spread)
+{
+    bench_base = timebase_now() + tbtick;
+    bench_spread = spread;
+    bench_fifo = bench_base;
+}
+
+
+//
+// deadline of the next timer event scheduled, relative to now
+//
+static tbtick_t bench_deadline(uint8_t pattern)
+{
+    tbtick_t tbtick;
+
+    switch (pattern)
+    {
+    case BENCH_RANDOM:
+        tbtick = bench_base + (tbtick_t) (((uint64_t) bench_random() * bench_spread) >> 16);
+        break;
+    case BENCH_FIFO:
+        tbtick = bench_fifo++;
+        break;
+    default:
+        tbtick = bench_base;
+        break;
+    }
+
+    return tbtick - timebase_now();
+}
+
+
+//
+// schedule a timer event, returns the timer counts taken
+//
+static tbtimer_t bench_schedule(struct timer_event * this_timer_event, uint8_t pattern)
+{
+    tbtimer_t counts;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        init_timer_event(this_timer_event, bench_deadline(pattern), bench_handler);
+
+        counts = TBTCNT;
+        schedule_timer_event(this_timer_event, NULL);
+        counts = TBTCNT - counts - bench_overhead;
+    }
+
+    return counts;
+}
+
+
+//
+// cancel a timer event, returns the timer counts taken
+//
+static tbtimer_t bench_cancel(struct timer_event * this_timer_event)
+{
+    tbtimer_t counts;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        counts = TBTCNT;
+        cancel_timer_event(this_timer_event);
+        counts = TBTCNT - counts - bench_overhead;
+    }
+
+    return counts;
+}
+
+
+//
+// print a CSV field, the average of count measurements in cpu cycles
+//
+static void bench_print(uint32_t value, uint16_t count)
+{
+    printf(",%lu", (unsigned long) (((uint64_t) value * TBTIMER_PRESCALER + (count / 2)) / count));
+}
+
+
+//
+// measure insert and cancel at each queue depth, then expiry of them all
+//
+static void bench_pattern(uint8_t pattern)
+{
+    uint16_t n;
+
+    for (n = 1; n <= BENCH_EVENTS; n <<= 1)
+    {
+        uint32_t insert_sum = 0;
+        uint32_t cancel_sum = 0;
+        uint32_t expire_sum = 0;
+        tbtimer_t insert_max = 0;
+        tbtimer_t cancel_max = 0;
+        tbtimer_t isr_max = 0;
+        tbtimer_t counts;
+        uint16_t i;
+
+        bench_deadlines(BENCH_HORIZON, BENCH_HORIZON);
+
+        // n - 1 live timer events
+        for (i = 0; i < (n - 1); i++)
+        {
+            bench_schedule(&bench_event[i], pattern);
+        }
+
+        for (i = 0; i < BENCH_REPEAT; i++)
+        {
+            struct timer_event * this_timer_event;
+
+            // insert the nth
+            counts = bench_schedule(&bench_event[n - 1], pattern);
+
+            insert_sum += counts;
+            if (counts > insert_max)
+            {
+                insert_max = counts;
+            }
+
+            // cancel one at random and put it back
+            this_timer_event = &bench_event[bench_random() % n];
+
+            counts = bench_cancel(this_timer_event);
+
+            cancel_sum += counts;
+            if (counts > cancel_max)
+            {
+                cancel_max = counts;
+            }
+
+            if (this_timer_event != &bench_event[n - 1])
+            {
+                bench_schedule(this_timer_event, pattern);
+                cancel_timer_event(&bench_event[n - 1]);
+            }
+        }
+
+        for (i = 0; i < (n - 1); i++)
+        {
+            cancel_timer_event(&bench_event[i]);
+        }
+
+        // n timer events due together
+        bench_deadlines(BENCH_EXPIRE_LEAD, BENCH_EXPIRE_SPREAD);
+
+        for (i = 0; i < n; i++)
+        {
+            bench_schedule(&bench_event[i], pattern);
+        }
+
+        while ((tbtick_st) (timebase_now() - (bench_base - BENCH_EXPIRE_GUARD)) < 0);
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            // wait until the last is due
+            while ((tbtick_st) (timebase_now() - (bench_base + BENCH_EXPIRE_SPREAD + n)) <= 0);
+
+            // passes of the handler until all have expired
+            do
+            {
+                counts = TBTCNT;
+                tbtimer_handler();
+                counts = TBTCNT - counts - bench_overhead;
+
+                expire_sum += counts;
+                if (counts > isr_max)
+                {
+                    isr_max = counts;
+                }
+
+                for (i = 0; (i < n) && timer_is_expired(&bench_event[i]); i++);
+            }
+            while (i < n);
+        }
+
+        printf("%s,%s,%u", BENCH_QUEUE, bench_pattern_name[pattern], n);
+
+        bench_print(insert_sum, BENCH_REPEAT);
+        bench_print(insert_max, 1);
+        bench_print(cancel_sum, BENCH_REPEAT);
+        bench_print(cancel_max, 1);
+        bench_print(expire_sum, n);
+        bench_print(isr_max, 1);
+
+        printf("\n");
+
+        // let the line go out before the next measurement
+        while (!console_tx_idle());
+    }
+}
+
+
+int main(void)
+{
+    uint8_t pattern;
+
+    ATOMIC_BLOCK(ATOMIC_FORCEON)
+    {
+        timer1_init();
+        timebase_init();
+        console_init();
+    }
+
+    // counts taken by an empty measurement
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        bench_overhead = TBTCNT;
+        bench_overhead = TBTCNT - bench_overhead;
+    }
+
+    printf("queue,pattern,n,insert_avg,insert_max,cancel_avg,cancel_max,expire_avg,isr_max\n");
+
+    for (pattern = BENCH_RANDOM; pattern <= BENCH_SAME; pattern++)
+    {
+        bench_seed = 1;
+        bench_pattern(pattern);
+    }
+
+    for (;;)
+    {
+        cli();
+        timer_idle();
+    }
+
+    return 0;
+}
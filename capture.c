@@ -0,0 +1,178 @@
+#include <avr/interrupt.h>
+
+#include "project.h"
+#include "timer.h"
+#include "capture.h"
+
+#if CAPTURE_SIZE & (CAPTURE_SIZE - 1)
+#error "CAPTURE_SIZE must be a power of 2."
+#endif
+
+//
+// single producer, single consumer ring of captures, the capture interrupt
+// is the only writer of capture_put and the main loop the only writer of
+// capture_get
+//
+static struct capture capture_ring[CAPTURE_SIZE];
+static volatile uint8_t capture_put;
+static volatile uint8_t capture_get_index;
+
+static uint8_t capture_mode;
+static volatile uint16_t capture_lost;
+
+
+//
+// select the edge to capture, a change of edge can set the capture flag so it
+// is cleared
+//
+static inline void capture_edge(uint8_t rising)
+{
+    if (rising)
+    {
+        TCCR1B |= _BV(ICES1);
+    }
+    else
+    {
+        TCCR1B &= ~_BV(ICES1);
+    }
+
+    TIFR1 = _BV(ICF1);
+}
+
+
+void capture_init(uint8_t mode)
+{
+    capture_mode = mode;
+    capture_put = capture_get_index = 0;
+    capture_lost = 0;
+
+    // ICP1 input, pull-up off
+    DDRB &= ~_BV(DDB0);
+    PORTB &= ~_BV(PORTB0);
+
+#if CAPTURE_NOISE_CANCEL
+    TCCR1B |= _BV(ICNC1);
+#else
+    TCCR1B &= ~_BV(ICNC1);
+#endif
+
+    capture_edge(mode != CAPTURE_FALLING);
+
+    // enable timer input capture interrupt
+    TIMSK1 |= _BV(ICIE1);
+}
+
+
+ISR(TIMER1_CAPT_vect)
+{
+    uint8_t put = capture_put;
+    uint8_t next = (put + 1) & (CAPTURE_SIZE - 1);
+    uint8_t rising = TCCR1B & _BV(ICES1);
+    tbtimer_t icr;
+    tbtick_t now;
+
+    // ICR1 reads share the timebase TEMP register
+    timebase_touch();
+
+    icr = ICR1;
+
+    if (capture_mode == CAPTURE_BOTH)
+    {
+        capture_edge(!rising);
+    }
+
+    // the capture is less than one timer turn before now
+    now = timebase_now();
+    now -= (tbtimer_t) ((tbtimer_t) now - icr);
+
+    if (next == capture_get_index)
+    {
+        // ring is full
+        if (capture_lost != UINT16_MAX)
+        {
+            capture_lost++;
+        }
+
+        return;
+    }
+
+    capture_ring[put].tbtick = now;
+    capture_ring[put].rising = rising ? 1 : 0;
+    capture_put = next;
+}
+
+
+//
+// take the oldest capture from the ring, returns 0 if the ring is empty
+//
+uint8_t capture_get(struct capture * capture)
+{
+    uint8_t get = capture_get_index;
+
+    if (get == capture_put)
+    {
+        return 0;
+    }
+
+    *capture = capture_ring[get];
+    capture_get_index = (get + 1) & (CAPTURE_SIZE - 1);
+
+    return 1;
+}
+
+
+//
+// captures lost to a full ring
+//
+uint16_t capture_dropped(void)
+{
+    uint16_t lost;
+
+    do
+    {
+        lost = capture_lost;
+    }
+    while (lost != capture_lost);
+
+    return lost;
+}
+
+
+//
+// take all captures from the ring and measure the signal cycle, a cycle runs
+// from one captured edge to the next of the same direction, returns the
+// number of cycles completed
+//
+uint8_t capture_measure(struct capture_cycle * cycle)
+{
+    struct capture capture;
+    uint8_t cycles = 0;
+
+    while (capture_get(&capture))
+    {
+        if (!capture.rising && (capture_mode == CAPTURE_BOTH))
+        {
+            cycle->fall = capture.tbtick;
+            cycle->state |= 2;
+            continue;
+        }
+
+        if (cycle->state & 1)
+        {
+            cycle->period = capture.tbtick - cycle->rise;
+
+            if (cycle->state & 2)
+            {
+                cycle->high = cycle->fall - cycle->rise;
+            }
+
+            cycles++;
+        }
+
+        // start the next cycle
+        cycle->rise = capture.tbtick;
+        cycle->state = 1;
+    }
+
+    return cycles;
+}
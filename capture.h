@@ -0,0 +1,69 @@
+#ifndef _CAPTURE_H_
+#define _CAPTURE_H_
+
+//
+// timer 1 input capture, ICP1 (PB0)
+//
+//  each edge on ICP1 is latched by the input capture unit and extended from
+//  ICR1 to a full tbtick_t timestamp, the timestamps are put on a ring by the
+//  capture interrupt and taken by the main loop without disabling interrupts
+//
+#if TBTIMER != 1
+#error "Input capture requires timer 1 as the timebase timer."
+#endif
+
+#ifndef CAPTURE_SIZE
+#define CAPTURE_SIZE 16
+#endif
+
+#ifndef CAPTURE_NOISE_CANCEL
+// default to the four sample noise canceler on
+#define CAPTURE_NOISE_CANCEL 1
+#endif
+
+//
+// capture modes
+//
+//  CAPTURE_BOTH toggles the edge select after each capture, an edge arriving
+//  before the capture interrupt has run is not captured
+//
+#define CAPTURE_RISING 0
+#define CAPTURE_FALLING 1
+#define CAPTURE_BOTH 2
+
+//
+// captured edge
+//
+struct capture {
+    tbtick_t tbtick;
+    uint8_t rising;
+};
+
+//
+// signal cycle measurement, see capture_measure()
+//
+//  period and high are in timebase ticks, high is only measured with
+//  CAPTURE_BOTH
+//
+struct capture_cycle {
+    tbtick_t rise;
+    tbtick_t fall;
+    tbtick_t period;
+    tbtick_t high;
+    uint8_t state;
+};
+
+#define CAPTURE_CYCLE_INIT { .state = 0 }
+
+//
+// frequency in mHz and duty cycle in 1/1000 of a measured cycle
+//
+#define capture_mhz(a) ((uint32_t) ((F_CPU * 1000ULL) / TBTIMER_PRESCALER) / (uint32_t) (a)->period)
+#define capture_duty(a) ((uint16_t) (((uint32_t) (a)->high * 1000UL) / (uint32_t) (a)->period))
+
+void capture_init(uint8_t mode);
+uint8_t capture_get(struct capture * capture);
+uint16_t capture_dropped(void);
+uint8_t capture_measure(struct capture_cycle * cycle);
+
+#endif // _CAPTURE_H_
@@ -5,7 +5,11 @@
 #include <avr/sleep.h>
 
 #include "project.h"
+#include "timer.h"
+#include "irqprof.h"
 #include "ring_buffer.h"
+#include "sched.h"
+#include "console.h"
 
 /*
  * Special characters used for translation and processing.
@@ -149,7 +153,14 @@ ISR(USART_UDRE_vect)
         /*
          * Get next echo or output byte.
          */
-        if (rb_echo(&rx_rb, &c) < 0) rb_get(&tx_rb, &c);
+        if (rb_echo(&rx_rb, &c) < 0) {
+            rb_get(&tx_rb, &c);
+
+            /*
+             * Wake tasks waiting for the output buffer to drain.
+             */
+            if (rb_cantget(&tx_rb)) sched_broadcast(TASK_SIGNAL_TX);
+        }
 
         if (is_onlcr() && (c == NL)) {
             /*
@@ -281,6 +292,11 @@ ISR(USART_RX_vect)
     if (c == NL) current_line = rx_rb.put;
 
     if (rb_full(&rx_rb)) rx_disable();
+
+    /*
+     * Wake tasks waiting for input.
+     */
+    if (console_rx_ready()) sched_broadcast(TASK_SIGNAL_RX);
 }
 
 
@@ -291,16 +307,16 @@ static int console_putchar(char c, struct __file * stream)
 {
     set_sleep_mode(SLEEP_MODE_IDLE);
     for (;;) {
-        cli();
+        irqprof_cli();
         if (rb_put(&tx_rb, (uint8_t *) &c) >= 0) break;
         sleep_enable();
-        sei();
+        irqprof_sei("console_putchar");
         sleep_cpu();
         sleep_disable();
     }
 
     tx_enable();
-    sei();
+    irqprof_sei("console_putchar");
 
     return 0;
 }
@@ -313,8 +329,9 @@ static int console_getchar(struct __file * stream)
 {
     char c;
 
+    set_sleep_mode(SLEEP_MODE_IDLE);
     for (;;) {
-        cli();
+        irqprof_cli();
         /*
          * In canonical mode wait for the current line to be complete or the
          * buffer to be full, which is an error condition and should never
@@ -324,19 +341,55 @@ static int console_getchar(struct __file * stream)
             if (rb_get(&rx_rb, (uint8_t *) &c) >= 0) break;
 
         if (is_inonblock()) {
-            sei();
+            irqprof_sei("console_getchar");
             return _FDEV_EOF;
         }
-        sei();
+        sleep_enable();
+        irqprof_sei("console_getchar");
+        sleep_cpu();
+        sleep_disable();
     }
 
     rx_enable();
-    sei();
+    irqprof_sei("console_getchar");
 
     return c;
 }
 
 
+/*
+ * Test if getchar will return without waiting, in canonical mode a complete
+ * line is ready. Safe to call from an interrupt handler.
+ */
+uint8_t console_rx_ready(void)
+{
+    uint8_t ready;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ready = (!is_icanon() || (rx_rb.get != current_line) ||
+                 rb_full(&rx_rb)) && !rb_cantget(&rx_rb);
+    }
+
+    return ready;
+}
+
+
+/*
+ * Test if the output buffer is empty, a line shorter than the buffer can be
+ * written without waiting.
+ */
+uint8_t console_tx_idle(void)
+{
+    uint8_t idle;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        idle = rb_cantget(&tx_rb) ? 1 : 0;
+    }
+
+    return idle;
+}
+
+
 static FILE console = FDEV_SETUP_STREAM(console_putchar, console_getchar,
                                         _FDEV_SETUP_RW);
 
@@ -376,7 +429,7 @@ void console_init(void)
     /* Set frame format: 8data, 2stop bit */
     UCSR0A = 0;
     UCSR0B = 0;
-    UCSR0C = CSTOPB | CS8;
+    UCSR0C = _BV(USBS0) | _BV(UCSZ01) | _BV(UCSZ00);
 
     rx_enable();
 }
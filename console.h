@@ -0,0 +1,8 @@
+#ifndef _CONSOLE_H_
+#define _CONSOLE_H_
+
+void console_init(void);
+uint8_t console_rx_ready(void);
+uint8_t console_tx_idle(void);
+
+#endif // _CONSOLE_H_
@@ -1,29 +1,228 @@
 #include <stdio.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
 
 #include "project.h"
+#include "timer.h"
 #include "dds.h"
+#include "irqprof.h"
 
+// the timebase compare output, OC1B by default, is the DDS FQ_UD pin
+#if TIMER_OUTPUT
+#error "TIMER_OUTPUT and the DDS share the FQ_UD pin PB2."
+#endif
 
-void dds_set(uint32_t tuning_word)
+//
+// asynchronous DDS loads
+//
+//  a DDS frame, the tuning word least significant byte first then the
+//  control byte, is queued and shifted out by the SPI transfer complete
+//  interrupt one byte at a time, the frame is latched by a FQ_UD strobe at
+//  the end of the transfer, or by a timer event at a given tbtick, before the
+//  next frame is started, the frames queued follow each other without the
+//  caller
+//
+//  the done function of a frame is called from the interrupt once the frame
+//  is latched
+//
+#define DDS_FRAME_LENGTH 5
+
+// latch at the frame tbtick
+#define DDS_FRAME_AT _BV(0)
+
+struct dds_frame {
+    uint8_t data[DDS_FRAME_LENGTH];
+    uint8_t length;
+    uint8_t flags;
+    tbtick_t tbtick;
+    void (* done)(void);
+};
+
+static struct dds_frame dds_frame[DDS_QUEUE_SIZE];
+static volatile uint8_t dds_put;
+static volatile uint8_t dds_get;
+
+// byte of the frame being shifted
+static uint8_t dds_byte;
+
+// timebase origin, the reference of a latch at an absolute tbtick
+static struct timer_event dds_origin;
+
+static int8_t dds_latch_handler(struct timer_event * this_timer_event);
+static struct timer_event dds_latch_event = TIMER_EVENT_INIT(dds_latch_event, dds_latch_handler);
+
+
+//
+// start shifting the frame at the head of the queue, called with interrupts
+// disabled
+//
+static void dds_start(void)
 {
-    dds_load(tuning_word, 0);
+    if (dds_put == dds_get)
+    {
+        spi_disable();
+        return;
+    }
+
+    dds_byte = 0;
+
+    SPCR = SPI_ENABLED | _BV(SPIE);
+    SPDR = dds_frame[dds_get & (DDS_QUEUE_SIZE - 1)].data[0];
 }
 
-void dds_power_down(void)
-{
-    // enable SPI
-    spi_enable();
 
-    // send power down command
-    SPDR = 0x04;
-    while (!test_bit(SPSR, SPIF));
+//
+// strobe FQ_UD, retire the frame and start the next, called with interrupts
+// disabled
+//
+static void dds_latch(void)
+{
+    void (* done)(void) = dds_frame[dds_get & (DDS_QUEUE_SIZE - 1)].done;
 
     // pulse FQ_UD high
     PINB = DDS_FQ_UD;
     PINB = DDS_FQ_UD;
 
-    // disable SPI
-    spi_disable();
+    dds_get++;
+
+    dds_start();
+
+    // the next frame is shifting, done may queue another
+    if (done)
+    {
+        done();
+    }
+}
+
+
+static int8_t dds_latch_handler(struct timer_event * this_timer_event)
+{
+    dds_latch();
+
+    return 0;
+}
+
+
+ISR(SPI_STC_vect)
+{
+    struct dds_frame * this_frame = &dds_frame[dds_get & (DDS_QUEUE_SIZE - 1)];
+
+    if (++dds_byte < this_frame->length)
+    {
+        SPDR = this_frame->data[dds_byte];
+        return;
+    }
+
+    if (this_frame->flags & DDS_FRAME_AT)
+    {
+        // hold the SPI until the latch
+        SPCR = SPI_ENABLED;
+
+        dds_latch_event.tbtick = this_frame->tbtick;
+        schedule_timer_event(&dds_latch_event, &dds_origin);
+        return;
+    }
+
+    dds_latch();
+}
+
+
+//
+// queue a frame, -1 if the queue is full
+//
+static int8_t dds_queue_frame(uint32_t tuning_word, uint8_t control, uint8_t length, uint8_t flags, tbtick_t tbtick, void (* done)(void))
+{
+    int8_t rc = -1;
+
+    IRQPROF_ATOMIC_BLOCK("dds_queue_frame")
+    {
+        if ((uint8_t) (dds_put - dds_get) < DDS_QUEUE_SIZE)
+        {
+            struct dds_frame * this_frame = &dds_frame[dds_put & (DDS_QUEUE_SIZE - 1)];
+            uint8_t i;
+
+            // tuning word, least significant byte first, then control
+            for (i = 0; i < 4; i++)
+            {
+                this_frame->data[i] = (uint8_t) (tuning_word >> (8 * i));
+            }
+
+            this_frame->data[4] = control;
+            this_frame->length = length;
+            this_frame->flags = flags;
+            this_frame->tbtick = tbtick;
+            this_frame->done = done;
+
+            if (dds_put++ == dds_get)
+            {
+                dds_start();
+            }
+
+            rc = 0;
+        }
+    }
+
+    return rc;
+}
+
+
+//
+// queue a frame latched once shifted, -1 if the queue is full
+//
+int8_t dds_queue(uint32_t tuning_word, uint8_t control, void (* done)(void))
+{
+    return dds_queue_frame(tuning_word, control, DDS_FRAME_LENGTH, 0, 0, done);
+}
+
+
+//
+// queue a frame latched at tbtick, or once shifted if tbtick has passed, -1
+// if the queue is full, the frames queued after it wait for the latch
+//
+int8_t dds_queue_at(uint32_t tuning_word, uint8_t control, tbtick_t tbtick, void (* done)(void))
+{
+    return dds_queue_frame(tuning_word, control, DDS_FRAME_LENGTH, DDS_FRAME_AT, tbtick, done);
+}
+
+
+//
+// test if every frame queued is latched
+//
+uint8_t dds_idle(void)
+{
+    return dds_put == dds_get;
+}
+
+
+//
+// queue a frame, sleeping while the queue is full
+//
+static void dds_queue_wait(uint32_t tuning_word, uint8_t control, uint8_t length)
+{
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    for (;;)
+    {
+        irqprof_cli();
+        if (dds_queue_frame(tuning_word, control, length, 0, 0, NULL) >= 0) break;
+        sleep_enable();
+        irqprof_sei("dds_queue_wait");
+        sleep_cpu();
+        sleep_disable();
+    }
+    irqprof_sei("dds_queue_wait");
+}
+
+
+void dds_set(uint32_t tuning_word)
+{
+    dds_queue_wait(tuning_word, 0, DDS_FRAME_LENGTH);
+}
+
+void dds_power_down(void)
+{
+    // power down command, the first byte shifted
+    dds_queue_wait(0x04, 0, 1);
 }
 
 void dds_reset(void)
@@ -18,63 +18,21 @@
 #define spi_disable() do {SPCR = SPI_DISABLED;} while (0)
 
 
-static inline void dds_load(uint32_t tuning_word, uint8_t control)
-{
-    uint8_t ival;
+//
+// DDS frames queued for the SPI, a power of two
+//
+#ifndef DDS_QUEUE_SIZE
+#define DDS_QUEUE_SIZE 4
+#endif
 
-    __asm__ __volatile__ (
-        "               ldi             %[ival], %[spi_enabled]      \n"
-        "               out             %[spcr], %[ival]             \n"
-        "               out             %[spdr], %A[tuning_word]     \n"
-        "               nop                                          \n"
-        "1:             in              __tmp_reg__, %[spsr]         \n"
-        "               sbrs            __tmp_reg__, %[spif]         \n"
-        "               rjmp            1b                           \n"
-        "               out             %[spdr], %B[tuning_word]     \n"
-        "               nop                                          \n"
-        "1:             in              __tmp_reg__, %[spsr]         \n"
-        "               sbrs            __tmp_reg__, %[spif]         \n"
-        "               rjmp            1b                           \n"
-        "               out             %[spdr], %C[tuning_word]     \n"
-        "               nop                                          \n"
-        "1:             in              __tmp_reg__, %[spsr]         \n"
-        "               sbrs            __tmp_reg__, %[spif]         \n"
-        "               rjmp            1b                           \n"
-        "               out             %[spdr], %D[tuning_word]     \n"
-        "               nop                                          \n"
-        "1:             in              __tmp_reg__, %[spsr]         \n"
-        "               sbrs            __tmp_reg__, %[spif]         \n"
-        "               rjmp            1b                           \n"
-        "               out             %[spdr], %[control]          \n"
-        "               nop                                          \n"
-        "1:             in              __tmp_reg__, %[spsr]         \n"
-        "               sbrs            __tmp_reg__, %[spif]         \n"
-        "               rjmp            1b                           \n"
-        "               ldi             %[ival], %[dds_fq_ud]        \n"
-        "               out             %[pinb], %[ival]             \n"
-        "               out             %[pinb], %[ival]             \n"
-        "               ldi             %[ival], %[spi_disabled]     \n"
-        "               out             %[spcr], %[ival]             \n"
-        : [ival] "=&d" (ival)
-        : [tuning_word] "r" (tuning_word),
-          [control] "r" (control),
-          // i/o registers
-          [pinb] "I" _SFR_IO_ADDR(PINB),
-          [spcr] "I" _SFR_IO_ADDR(SPCR),
-          [spsr] "I" _SFR_IO_ADDR(SPSR),
-          [spdr] "I" _SFR_IO_ADDR(SPDR),
-          // i/o register bits
-          [spi_enabled] "M" (SPI_ENABLED),
-          [spi_disabled] "M" (SPI_DISABLED),
-          [dds_fq_ud] "M" (DDS_FQ_UD),
-          [spif] "M" (SPIF)
-        : "r0"
-    );
-}
+_Static_assert((DDS_QUEUE_SIZE & (DDS_QUEUE_SIZE - 1)) == 0, "DDS_QUEUE_SIZE is not a power of two.");
 
 void dds_init(void);
 void dds_reset(void);
 void dds_power_down(void);
 void dds_set(uint32_t tuning_word);
+int8_t dds_queue(uint32_t tuning_word, uint8_t control, void (* done)(void));
+int8_t dds_queue_at(uint32_t tuning_word, uint8_t control, tbtick_t tbtick, void (* done)(void));
+uint8_t dds_idle(void);
 
 #endif // _DDS_H_
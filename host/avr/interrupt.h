@@ -0,0 +1,33 @@
+#ifndef _AVR_INTERRUPT_H_
+#define _AVR_INTERRUPT_H_
+
+//
+// interrupts for host builds, see sim.h
+//
+//  an interrupt service routine is a plain function called by the simulator,
+//  vectors without one are fatal when their interrupt is taken
+//
+#include <avr/io.h>
+
+#define sei() sim_sei()
+#define cli() sim_cli()
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+#define ISR_ALIASOF(v)
+
+#define ISR(vector, ...) void vector(void); void vector(void)
+
+#define EMPTY_INTERRUPT(vector) void vector(void); void vector(void) {}
+
+void TIMER1_CAPT_vect(void);
+void TIMER1_COMPA_vect(void);
+void TIMER1_COMPB_vect(void);
+void TIMER1_OVF_vect(void);
+void SPI_STC_vect(void);
+void USART_RX_vect(void);
+void USART_UDRE_vect(void);
+void USART_TX_vect(void);
+
+#endif // _AVR_INTERRUPT_H_
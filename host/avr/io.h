@@ -0,0 +1,312 @@
+#ifndef _AVR_IO_H_
+#define _AVR_IO_H_
+
+//
+// ATmega328P i/o registers for host builds, see sim.h
+//
+#include <stdint.h>
+
+#include "../sim.h"
+
+#define _BV(bit) (1 << (bit))
+
+//
+// registers
+//
+#define GPIOR0 (*sim_io8(SIM_GPIOR0))
+#define GPIOR1 (*sim_io8(SIM_GPIOR1))
+#define GPIOR2 (*sim_io8(SIM_GPIOR2))
+
+#define PINB (*sim_io8(SIM_PINB))
+#define DDRB (*sim_io8(SIM_DDRB))
+#define PORTB (*sim_io8(SIM_PORTB))
+#define PINC (*sim_io8(SIM_PINC))
+#define DDRC (*sim_io8(SIM_DDRC))
+#define PORTC (*sim_io8(SIM_PORTC))
+#define PIND (*sim_io8(SIM_PIND))
+#define DDRD (*sim_io8(SIM_DDRD))
+#define PORTD (*sim_io8(SIM_PORTD))
+
+#define SREG (*sim_io8(SIM_SREG))
+#define SMCR (*sim_io8(SIM_SMCR))
+#define PRR (*sim_io8(SIM_PRR))
+#define MCUSR (*sim_io8(SIM_MCUSR))
+
+#define EICRA (*sim_io8(SIM_EICRA))
+#define EIMSK (*sim_io8(SIM_EIMSK))
+#define EIFR (*sim_io8(SIM_EIFR))
+#define PCICR (*sim_io8(SIM_PCICR))
+#define PCIFR (*sim_io8(SIM_PCIFR))
+#define PCMSK0 (*sim_io8(SIM_PCMSK0))
+#define PCMSK1 (*sim_io8(SIM_PCMSK1))
+#define PCMSK2 (*sim_io8(SIM_PCMSK2))
+
+#define TCCR0A (*sim_io8(SIM_TCCR0A))
+#define TCCR0B (*sim_io8(SIM_TCCR0B))
+#define TCNT0 (*sim_io8(SIM_TCNT0))
+#define OCR0A (*sim_io8(SIM_OCR0A))
+#define OCR0B (*sim_io8(SIM_OCR0B))
+#define TIMSK0 (*sim_io8(SIM_TIMSK0))
+#define TIFR0 (*sim_io8(SIM_TIFR0))
+
+#define TCCR1A (*sim_io8(SIM_TCCR1A))
+#define TCCR1B (*sim_io8(SIM_TCCR1B))
+#define TCCR1C (*sim_io8(SIM_TCCR1C))
+#define TCNT1 (*sim_io16(SIM_TCNT1))
+#define OCR1A (*sim_io16(SIM_OCR1A))
+#define OCR1B (*sim_io16(SIM_OCR1B))
+#define ICR1 (*sim_io16(SIM_ICR1))
+#define TIMSK1 (*sim_io8(SIM_TIMSK1))
+#define TIFR1 (*sim_io8(SIM_TIFR1))
+
+#define TCCR2A (*sim_io8(SIM_TCCR2A))
+#define TCCR2B (*sim_io8(SIM_TCCR2B))
+#define TCNT2 (*sim_io8(SIM_TCNT2))
+#define OCR2A (*sim_io8(SIM_OCR2A))
+#define OCR2B (*sim_io8(SIM_OCR2B))
+#define TIMSK2 (*sim_io8(SIM_TIMSK2))
+#define TIFR2 (*sim_io8(SIM_TIFR2))
+#define ASSR (*sim_io8(SIM_ASSR))
+#define GTCCR (*sim_io8(SIM_GTCCR))
+
+#define SPCR (*sim_io8(SIM_SPCR))
+#define SPSR (*sim_io8(SIM_SPSR))
+#define SPDR (*sim_io8(SIM_SPDR))
+
+#define UCSR0A (*sim_io8(SIM_UCSR0A))
+#define UCSR0B (*sim_io8(SIM_UCSR0B))
+#define UCSR0C (*sim_io8(SIM_UCSR0C))
+#define UDR0 (*sim_io8(SIM_UDR0))
+#define UBRR0 (*sim_io16(SIM_UBRR0))
+
+#define ACSR (*sim_io8(SIM_ACSR))
+#define DIDR0 (*sim_io8(SIM_DIDR0))
+#define DIDR1 (*sim_io8(SIM_DIDR1))
+
+//
+// register bits
+//
+#define PINB7 7
+#define PINB6 6
+#define PINB5 5
+#define PINB4 4
+#define PINB3 3
+#define PINB2 2
+#define PINB1 1
+#define PINB0 0
+
+#define DDB7 7
+#define DDB6 6
+#define DDB5 5
+#define DDB4 4
+#define DDB3 3
+#define DDB2 2
+#define DDB1 1
+#define DDB0 0
+
+#define PORTB7 7
+#define PORTB6 6
+#define PORTB5 5
+#define PORTB4 4
+#define PORTB3 3
+#define PORTB2 2
+#define PORTB1 1
+#define PORTB0 0
+
+#define PINC6 6
+#define PINC5 5
+#define PINC4 4
+#define PINC3 3
+#define PINC2 2
+#define PINC1 1
+#define PINC0 0
+
+#define DDC6 6
+#define DDC5 5
+#define DDC4 4
+#define DDC3 3
+#define DDC2 2
+#define DDC1 1
+#define DDC0 0
+
+#define PORTC6 6
+#define PORTC5 5
+#define PORTC4 4
+#define PORTC3 3
+#define PORTC2 2
+#define PORTC1 1
+#define PORTC0 0
+
+#define PIND7 7
+#define PIND6 6
+#define PIND5 5
+#define PIND4 4
+#define PIND3 3
+#define PIND2 2
+#define PIND1 1
+#define PIND0 0
+
+#define DDD7 7
+#define DDD6 6
+#define DDD5 5
+#define DDD4 4
+#define DDD3 3
+#define DDD2 2
+#define DDD1 1
+#define DDD0 0
+
+#define PORTD7 7
+#define PORTD6 6
+#define PORTD5 5
+#define PORTD4 4
+#define PORTD3 3
+#define PORTD2 2
+#define PORTD1 1
+#define PORTD0 0
+
+// SREG
+#define SREG_I 7
+#define SREG_T 6
+#define SREG_H 5
+#define SREG_S 4
+#define SREG_V 3
+#define SREG_N 2
+#define SREG_Z 1
+#define SREG_C 0
+
+// SMCR
+#define SM2 3
+#define SM1 2
+#define SM0 1
+#define SE 0
+
+// EICRA, EIMSK, EIFR
+#define ISC11 3
+#define ISC10 2
+#define ISC01 1
+#define ISC00 0
+#define INT1 1
+#define INT0 0
+#define INTF1 1
+#define INTF0 0
+
+// PCICR, PCIFR
+#define PCIE2 2
+#define PCIE1 1
+#define PCIE0 0
+#define PCIF2 2
+#define PCIF1 1
+#define PCIF0 0
+
+// TCCR0A, TCCR0B, TIMSK0, TIFR0
+#define COM0A1 7
+#define COM0A0 6
+#define COM0B1 5
+#define COM0B0 4
+#define WGM01 1
+#define WGM00 0
+#define FOC0A 7
+#define FOC0B 6
+#define WGM02 3
+#define CS02 2
+#define CS01 1
+#define CS00 0
+#define OCIE0B 2
+#define OCIE0A 1
+#define TOIE0 0
+#define OCF0B 2
+#define OCF0A 1
+#define TOV0 0
+
+// TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1
+#define COM1A1 7
+#define COM1A0 6
+#define COM1B1 5
+#define COM1B0 4
+#define WGM11 1
+#define WGM10 0
+#define ICNC1 7
+#define ICES1 6
+#define WGM13 4
+#define WGM12 3
+#define CS12 2
+#define CS11 1
+#define CS10 0
+#define FOC1A 7
+#define FOC1B 6
+#define ICIE1 5
+#define OCIE1B 2
+#define OCIE1A 1
+#define TOIE1 0
+#define ICF1 5
+#define OCF1B 2
+#define OCF1A 1
+#define TOV1 0
+
+// TCCR2A, TCCR2B, TIMSK2, TIFR2, ASSR
+#define COM2A1 7
+#define COM2A0 6
+#define COM2B1 5
+#define COM2B0 4
+#define WGM21 1
+#define WGM20 0
+#define FOC2A 7
+#define FOC2B 6
+#define WGM22 3
+#define CS22 2
+#define CS21 1
+#define CS20 0
+#define OCIE2B 2
+#define OCIE2A 1
+#define TOIE2 0
+#define OCF2B 2
+#define OCF2A 1
+#define TOV2 0
+#define EXCLK 6
+#define AS2 5
+#define TCN2UB 4
+#define OCR2AUB 3
+#define OCR2BUB 2
+#define TCR2AUB 1
+#define TCR2BUB 0
+
+// SPCR, SPSR
+#define SPIE 7
+#define SPE 6
+#define DORD 5
+#define MSTR 4
+#define CPOL 3
+#define CPHA 2
+#define SPR1 1
+#define SPR0 0
+#define SPIF 7
+#define WCOL 6
+#define SPI2X 0
+
+// UCSR0A, UCSR0B, UCSR0C
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define FE0 4
+#define DOR0 3
+#define UPE0 2
+#define U2X0 1
+#define MPCM0 0
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+#define UCSZ02 2
+#define RXB80 1
+#define TXB80 0
+#define UMSEL01 7
+#define UMSEL00 6
+#define UPM01 5
+#define UPM00 4
+#define USBS0 3
+#define UCSZ01 2
+#define UCSZ00 1
+#define UCPOL0 0
+
+#endif // _AVR_IO_H_
@@ -0,0 +1,23 @@
+#ifndef _AVR_PGMSPACE_H_
+#define _AVR_PGMSPACE_H_
+
+//
+// program memory for host builds, flash and ram share one address space
+//
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+
+#define pgm_read_byte(a) (*(const uint8_t *) (a))
+#define pgm_read_word(a) (*(const uint16_t *) (a))
+#define pgm_read_dword(a) (*(const uint32_t *) (a))
+#define pgm_read_ptr(a) (*(void * const *) (a))
+
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+
+#endif // _AVR_PGMSPACE_H_
@@ -0,0 +1,33 @@
+#ifndef _AVR_SLEEP_H_
+#define _AVR_SLEEP_H_
+
+//
+// sleep modes for host builds, see sim.h, every mode sleeps until the next
+// interrupt
+//
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE (0)
+#define SLEEP_MODE_ADC _BV(SM0)
+#define SLEEP_MODE_PWR_DOWN _BV(SM1)
+#define SLEEP_MODE_PWR_SAVE (_BV(SM0) | _BV(SM1))
+#define SLEEP_MODE_STANDBY (_BV(SM1) | _BV(SM2))
+#define SLEEP_MODE_EXT_STANDBY (_BV(SM0) | _BV(SM1) | _BV(SM2))
+
+#define set_sleep_mode(mode)                                                   \
+    do {                                                                       \
+        SMCR = (SMCR & ~(_BV(SM0) | _BV(SM1) | _BV(SM2))) | (mode);            \
+    } while (0)
+
+#define sleep_enable() do {SMCR |= _BV(SE);} while (0)
+#define sleep_disable() do {SMCR &= ~_BV(SE);} while (0)
+#define sleep_cpu() sim_sleep()
+
+#define sleep_mode()                                                           \
+    do {                                                                       \
+        sleep_enable();                                                        \
+        sleep_cpu();                                                           \
+        sleep_disable();                                                       \
+    } while (0)
+
+#endif // _AVR_SLEEP_H_
@@ -0,0 +1,983 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <avr/io.h>
+
+#include "sim.h"
+
+//
+// simulator state
+//
+static uint8_t reg8[SIM_REG8_N];
+static uint16_t reg16[SIM_REG16_N];
+
+static uint64_t cycles;
+static uint64_t cycles_limit;
+
+// cycles of code run since time last passed, see __sanitizer_cov_trace_pc()
+static uint64_t cycles_code;
+
+//
+// register access waiting to be committed, the accessor returns a pointer to
+// the register and the value found there at the next call is what was written
+//
+static struct {
+    uint8_t valid;
+    uint8_t wide;
+    uint8_t reg;
+    uint8_t rx_vector;
+    uint16_t old;
+} pending;
+
+//
+// interrupt being serviced
+//
+static void (* vector)(void);
+static uint32_t vectors_taken;
+
+// sei was the last instruction, no interrupt is taken until the next
+static uint8_t sei_shadow;
+
+//
+// timer 1
+//
+static uint32_t timer1_div;
+static uint64_t timer1_next;
+static uint8_t timer1_blocked;
+static uint8_t oc1[2];
+static uint8_t icp1;
+
+//
+// USART
+//
+static uint64_t tx_done;
+static uint8_t tx_shift;
+static uint8_t tx_buf;
+static uint8_t tx_busy;
+static uint8_t tx_full;
+
+static uint8_t rx_fifo[2];
+static uint8_t rx_fifo_n;
+static uint8_t * rx_wire;
+static uint32_t rx_wire_n;
+static uint32_t rx_wire_size;
+static uint64_t rx_next;
+
+uint8_t sim_stdin = 1;
+
+//
+// SPI
+//
+static uint64_t spi_done;
+static uint8_t spi_busy;
+static uint8_t spi_byte;
+
+static void sim_usart_tx_stdout(uint8_t c, uint64_t when);
+
+void (* sim_usart_tx_hook)(uint8_t c, uint64_t cycles) = sim_usart_tx_stdout;
+void (* sim_spi_tx_hook)(uint8_t c, uint64_t cycles);
+void (* sim_oc1_hook)(uint8_t channel, uint8_t level, uint64_t cycles);
+void (* sim_port_hook)(uint8_t port, uint8_t level, uint64_t cycles);
+
+//
+// interrupt vectors, highest priority first, a vector without an interrupt
+// service routine is a null weak reference
+//
+extern void TIMER1_CAPT_vect(void) __attribute__((weak));
+extern void TIMER1_COMPA_vect(void) __attribute__((weak));
+extern void TIMER1_COMPB_vect(void) __attribute__((weak));
+extern void TIMER1_OVF_vect(void) __attribute__((weak));
+extern void SPI_STC_vect(void) __attribute__((weak));
+extern void USART_RX_vect(void) __attribute__((weak));
+extern void USART_UDRE_vect(void) __attribute__((weak));
+extern void USART_TX_vect(void) __attribute__((weak));
+
+struct sim_vector {
+    void (* isr)(void);
+    const char * name;
+    uint8_t flag_reg;
+    uint8_t flag;
+    uint8_t enable_reg;
+    uint8_t enable;
+    uint8_t clear;
+};
+
+#define SIM_VECTOR(v,fr,f,er,e,c) { v, #v, fr, _BV(f), er, _BV(e), c }
+
+static const struct sim_vector sim_vectors[] = {
+    SIM_VECTOR(TIMER1_CAPT_vect, SIM_TIFR1, ICF1, SIM_TIMSK1, ICIE1, 1),
+    SIM_VECTOR(TIMER1_COMPA_vect, SIM_TIFR1, OCF1A, SIM_TIMSK1, OCIE1A, 1),
+    SIM_VECTOR(TIMER1_COMPB_vect, SIM_TIFR1, OCF1B, SIM_TIMSK1, OCIE1B, 1),
+    SIM_VECTOR(TIMER1_OVF_vect, SIM_TIFR1, TOV1, SIM_TIMSK1, TOIE1, 1),
+    SIM_VECTOR(SPI_STC_vect, SIM_SPSR, SPIF, SIM_SPCR, SPIE, 1),
+    SIM_VECTOR(USART_RX_vect, SIM_UCSR0A, RXC0, SIM_UCSR0B, RXCIE0, 0),
+    SIM_VECTOR(USART_UDRE_vect, SIM_UCSR0A, UDRE0, SIM_UCSR0B, UDRIE0, 0),
+    SIM_VECTOR(USART_TX_vect, SIM_UCSR0A, TXC0, SIM_UCSR0B, TXCIE0, 1),
+};
+
+#define SIM_VECTORS (sizeof(sim_vectors) / sizeof(sim_vectors[0]))
+
+
+static void sim_fatal(const char * msg)
+{
+    char buffer[128];
+    int n;
+
+    n = snprintf(buffer, sizeof(buffer), "sim: %s at cycle %llu\n", msg,
+                 (unsigned long long) cycles);
+
+    if (write(2, buffer, n) < 0)
+    {
+        // nothing more to do
+    }
+
+    exit(1);
+}
+
+
+static void sim_usart_tx_stdout(uint8_t c, uint64_t when)
+{
+    (void) when;
+
+    if (write(1, &c, 1) < 0)
+    {
+        sim_fatal("USART output lost");
+    }
+}
+
+
+static void sim_advance(uint64_t until);
+static void sim_spend(uint64_t n);
+
+
+//
+// timer 1
+//
+
+static void timer1_prescaler(void)
+{
+    static const uint16_t div[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+    timer1_div = div[reg8[SIM_TCCR1B] & (_BV(CS12) | _BV(CS11) | _BV(CS10))];
+    timer1_next = cycles + timer1_div;
+}
+
+
+static void timer1_oc(uint8_t channel, uint8_t level)
+{
+    if (oc1[channel] != level)
+    {
+        oc1[channel] = level;
+
+        if (sim_oc1_hook)
+        {
+            sim_oc1_hook(channel, level, cycles);
+        }
+    }
+}
+
+
+//
+// compare output action of a channel, match or force
+//
+static void timer1_compare_output(uint8_t channel)
+{
+    uint8_t com = (reg8[SIM_TCCR1A] >> (channel ? COM1B0 : COM1A0)) & 3;
+
+    switch (com)
+    {
+    case 1:
+        timer1_oc(channel, !oc1[channel]);
+        break;
+    case 2:
+        timer1_oc(channel, 0);
+        break;
+    case 3:
+        timer1_oc(channel, 1);
+        break;
+    }
+}
+
+
+static void timer1_tick(void)
+{
+    uint16_t count = ++reg16[SIM_TCNT1];
+
+    timer1_next += timer1_div;
+
+    if (count == 0)
+    {
+        reg8[SIM_TIFR1] |= _BV(TOV1);
+    }
+
+    if (timer1_blocked)
+    {
+        // compare blocked for one timer clock after TCNT1 is written
+        timer1_blocked = 0;
+        return;
+    }
+
+    if (count == reg16[SIM_OCR1A])
+    {
+        reg8[SIM_TIFR1] |= _BV(OCF1A);
+        timer1_compare_output(0);
+    }
+
+    if (count == reg16[SIM_OCR1B])
+    {
+        reg8[SIM_TIFR1] |= _BV(OCF1B);
+        timer1_compare_output(1);
+    }
+}
+
+
+//
+// USART
+//
+
+static uint64_t usart_frame(void)
+{
+    uint8_t ucsr0c = reg8[SIM_UCSR0C];
+    uint8_t bits = 1 + 5 + ((ucsr0c >> UCSZ00) & 3);
+
+    bits += (ucsr0c & _BV(UPM01)) ? 1 : 0;
+    bits += (ucsr0c & _BV(USBS0)) ? 2 : 1;
+
+    return (uint64_t) ((reg8[SIM_UCSR0A] & _BV(U2X0)) ? 8 : 16) *
+           (reg16[SIM_UBRR0] + 1) * bits;
+}
+
+
+static void usart_tx_load(uint8_t c)
+{
+    tx_shift = c;
+    tx_busy = 1;
+    tx_done = cycles + usart_frame();
+    reg8[SIM_UCSR0A] &= ~_BV(TXC0);
+}
+
+
+static void usart_tx_write(uint8_t c)
+{
+    if (!(reg8[SIM_UCSR0B] & _BV(TXEN0)) || tx_full)
+    {
+        // transmitter off or data register full, the byte is lost
+        return;
+    }
+
+    if (!tx_busy)
+    {
+        usart_tx_load(c);
+    }
+    else
+    {
+        tx_buf = c;
+        tx_full = 1;
+        reg8[SIM_UCSR0A] &= ~_BV(UDRE0);
+    }
+}
+
+
+static void usart_tx_done(void)
+{
+    tx_busy = 0;
+
+    if (sim_usart_tx_hook)
+    {
+        sim_usart_tx_hook(tx_shift, cycles);
+    }
+
+    if (tx_full)
+    {
+        tx_full = 0;
+        reg8[SIM_UCSR0A] |= _BV(UDRE0);
+        usart_tx_load(tx_buf);
+    }
+    else
+    {
+        reg8[SIM_UCSR0A] |= _BV(TXC0);
+    }
+}
+
+
+static void usart_rx_done(void)
+{
+    uint8_t c = rx_wire[0];
+
+    memmove(rx_wire, rx_wire + 1, --rx_wire_n);
+    rx_next = (rx_wire_n) ? (cycles + usart_frame()) : 0;
+
+    if (!(reg8[SIM_UCSR0B] & _BV(RXEN0)))
+    {
+        // receiver off
+        return;
+    }
+
+    if (rx_fifo_n == sizeof(rx_fifo))
+    {
+        // receive fifo full
+        reg8[SIM_UCSR0A] |= _BV(DOR0);
+        return;
+    }
+
+    rx_fifo[rx_fifo_n++] = c;
+    reg8[SIM_UDR0] = rx_fifo[0];
+    reg8[SIM_UCSR0A] |= _BV(RXC0);
+}
+
+
+static void usart_rx_read(void)
+{
+    if (rx_fifo_n)
+    {
+        rx_fifo[0] = rx_fifo[1];
+        rx_fifo_n--;
+    }
+
+    if (rx_fifo_n)
+    {
+        reg8[SIM_UDR0] = rx_fifo[0];
+    }
+    else
+    {
+        reg8[SIM_UCSR0A] &= ~(_BV(RXC0) | _BV(DOR0));
+    }
+}
+
+
+void sim_usart_rx(uint8_t c)
+{
+    if (rx_wire_n == rx_wire_size)
+    {
+        rx_wire_size = (rx_wire_size) ? (rx_wire_size * 2) : 64;
+
+        if (!(rx_wire = realloc(rx_wire, rx_wire_size)))
+        {
+            sim_fatal("out of memory");
+        }
+    }
+
+    rx_wire[rx_wire_n++] = c;
+
+    if (!rx_next)
+    {
+        rx_next = cycles + usart_frame();
+    }
+}
+
+
+void sim_usart_rx_str(const char * s)
+{
+    while (*s)
+    {
+        sim_usart_rx((uint8_t) *s++);
+    }
+}
+
+
+//
+// poll the host standard input for the USART receiver
+//
+static void usart_rx_stdin(void)
+{
+    struct pollfd fds = { .fd = 0, .events = POLLIN };
+    uint8_t buffer[64];
+    ssize_t n;
+    ssize_t i;
+
+    if (!sim_stdin || rx_wire_n || (poll(&fds, 1, 0) <= 0))
+    {
+        return;
+    }
+
+    if ((n = read(0, buffer, sizeof(buffer))) <= 0)
+    {
+        // end of input
+        sim_stdin = 0;
+        return;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        sim_usart_rx(buffer[i]);
+    }
+}
+
+
+//
+// SPI
+//
+
+static void spi_write(uint8_t c)
+{
+    static const uint8_t div[4] = { 4, 16, 64, 128 };
+    uint32_t clocks;
+
+    if (!(reg8[SIM_SPCR] & _BV(SPE)))
+    {
+        return;
+    }
+
+    if (spi_busy)
+    {
+        reg8[SIM_SPSR] |= _BV(WCOL);
+        return;
+    }
+
+    clocks = div[reg8[SIM_SPCR] & (_BV(SPR1) | _BV(SPR0))];
+
+    if (reg8[SIM_SPSR] & _BV(SPI2X))
+    {
+        clocks /= 2;
+    }
+
+    reg8[SIM_SPSR] &= ~(_BV(SPIF) | _BV(WCOL));
+    spi_byte = c;
+    spi_busy = 1;
+    spi_done = cycles + 8 * clocks;
+}
+
+
+static void spi_transfer_done(void)
+{
+    spi_busy = 0;
+
+    if (sim_spi_tx_hook)
+    {
+        sim_spi_tx_hook(spi_byte, cycles);
+    }
+
+    // nothing connected to MISO
+    reg8[SIM_SPDR] = 0xff;
+    reg8[SIM_SPSR] |= _BV(SPIF);
+}
+
+
+//
+// interrupts
+//
+
+static void sim_commit(void);
+
+
+static void sim_take(const struct sim_vector * v)
+{
+    void (* interrupted)(void) = vector;
+
+    if (!v->isr)
+    {
+        sim_fatal(v->name);
+    }
+
+    if (v->clear)
+    {
+        reg8[v->flag_reg] &= ~v->flag;
+    }
+
+    vectors_taken++;
+
+    reg8[SIM_SREG] &= ~_BV(SREG_I);
+    sim_spend(SIM_ISR_CYCLES / 2);
+
+    vector = v->isr;
+    v->isr();
+    sim_commit();
+    vector = interrupted;
+
+    reg8[SIM_SREG] |= _BV(SREG_I);
+    sim_spend(SIM_ISR_CYCLES - SIM_ISR_CYCLES / 2);
+}
+
+
+static const struct sim_vector * sim_pending(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < SIM_VECTORS; i++)
+    {
+        const struct sim_vector * v = &sim_vectors[i];
+
+        if ((reg8[v->flag_reg] & v->flag) && (reg8[v->enable_reg] & v->enable))
+        {
+            return v;
+        }
+    }
+
+    return NULL;
+}
+
+
+static void sim_deliver(void)
+{
+    const struct sim_vector * v;
+
+    if (sei_shadow)
+    {
+        return;
+    }
+
+    while ((reg8[SIM_SREG] & _BV(SREG_I)) && (v = sim_pending()))
+    {
+        sim_take(v);
+    }
+}
+
+
+//
+// time
+//
+
+static uint64_t sim_next_event(uint64_t until)
+{
+    if (timer1_div && (timer1_next < until))
+    {
+        until = timer1_next;
+    }
+
+    if (tx_busy && (tx_done < until))
+    {
+        until = tx_done;
+    }
+
+    if (rx_next && (rx_next < until))
+    {
+        until = rx_next;
+    }
+
+    if (spi_busy && (spi_done < until))
+    {
+        until = spi_done;
+    }
+
+    return until;
+}
+
+
+static void sim_advance(uint64_t until)
+{
+    while (cycles < until)
+    {
+        cycles = sim_next_event(until);
+
+        if (cycles_limit && (cycles >= cycles_limit))
+        {
+            exit(0);
+        }
+
+        if (timer1_div && (timer1_next == cycles))
+        {
+            timer1_tick();
+        }
+
+        if (tx_busy && (tx_done == cycles))
+        {
+            usart_tx_done();
+        }
+
+        if (rx_next && (rx_next == cycles))
+        {
+            usart_rx_done();
+        }
+
+        if (spi_busy && (spi_done == cycles))
+        {
+            spi_transfer_done();
+        }
+
+        sim_deliver();
+    }
+}
+
+
+//
+// let n cycles pass after the code run since time last passed
+//
+static void sim_spend(uint64_t n)
+{
+    sei_shadow = 0;
+
+    n += cycles_code;
+    cycles_code = 0;
+
+    sim_advance(cycles + n);
+}
+
+
+//
+// code cost, called at the start of each basic block of the sources built
+// with -fsanitize-coverage=trace-pc
+//
+void __sanitizer_cov_trace_pc(void)
+{
+    cycles_code += SIM_BLOCK_CYCLES;
+}
+
+
+uint64_t sim_cycles(void)
+{
+    return cycles;
+}
+
+
+void sim_limit(uint64_t limit)
+{
+    cycles_limit = limit;
+}
+
+
+//
+// registers
+//
+
+static void sim_write8(uint8_t reg, uint8_t old, uint8_t value, uint8_t rx_vector)
+{
+    switch (reg)
+    {
+    case SIM_SREG:
+        if (!(old & _BV(SREG_I)) && (value & _BV(SREG_I)))
+        {
+            // interrupts enabled by restoring SREG
+            sim_deliver();
+        }
+        break;
+
+    case SIM_TIFR0:
+    case SIM_TIFR1:
+    case SIM_TIFR2:
+    case SIM_EIFR:
+    case SIM_PCIFR:
+        // write one to clear
+        reg8[reg] = old & ~value;
+        break;
+
+    case SIM_PINB:
+    case SIM_PINC:
+    case SIM_PIND:
+        // write one to toggle
+        reg8[reg + 2] ^= value;
+        reg8[reg] = reg8[reg + 2];
+
+        if (sim_port_hook && value)
+        {
+            sim_port_hook((reg - SIM_PINB) / 3, reg8[reg + 2], cycles);
+        }
+        break;
+
+    case SIM_PORTB:
+    case SIM_PORTC:
+    case SIM_PORTD:
+        if (sim_port_hook)
+        {
+            sim_port_hook((reg - SIM_PORTB) / 3, value, cycles);
+        }
+        break;
+
+    case SIM_TCCR1B:
+        if ((old ^ value) & (_BV(CS12) | _BV(CS11) | _BV(CS10)))
+        {
+            timer1_prescaler();
+        }
+        break;
+
+    case SIM_TCCR1C:
+        if (value & _BV(FOC1A))
+        {
+            timer1_compare_output(0);
+        }
+
+        if (value & _BV(FOC1B))
+        {
+            timer1_compare_output(1);
+        }
+
+        // strobes read as zero
+        reg8[reg] = 0;
+        break;
+
+    case SIM_SPSR:
+        // only SPI2X is writable
+        reg8[reg] = (old & ~_BV(SPI2X)) | (value & _BV(SPI2X));
+        break;
+
+    case SIM_SPDR:
+        reg8[reg] = old;
+        spi_write(value);
+        break;
+
+    case SIM_UCSR0A:
+        reg8[reg] = (old & ~(_BV(U2X0) | _BV(MPCM0))) |
+                    (value & (_BV(U2X0) | _BV(MPCM0)));
+
+        if (value & _BV(TXC0))
+        {
+            reg8[reg] &= ~_BV(TXC0);
+        }
+        break;
+
+    case SIM_UDR0:
+        if (rx_vector)
+        {
+            usart_rx_read();
+        }
+        else
+        {
+            reg8[reg] = old;
+            usart_tx_write(value);
+        }
+        break;
+    }
+}
+
+
+static void sim_write16(uint8_t reg, uint16_t old, uint16_t value)
+{
+    switch (reg)
+    {
+    case SIM_TCNT1:
+        timer1_blocked = 1;
+        break;
+
+    case SIM_ICR1:
+        // read only in normal mode
+        reg16[reg] = old;
+        break;
+    }
+}
+
+
+static uint8_t sim_strobe(uint8_t reg)
+{
+    switch (reg)
+    {
+    case SIM_TIFR0:
+    case SIM_TIFR1:
+    case SIM_TIFR2:
+    case SIM_EIFR:
+    case SIM_PCIFR:
+    case SIM_PINB:
+    case SIM_PINC:
+    case SIM_PIND:
+    case SIM_TCCR1C:
+    case SIM_SPDR:
+    case SIM_UDR0:
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static void sim_commit(void)
+{
+    if (!pending.valid)
+    {
+        return;
+    }
+
+    pending.valid = 0;
+
+    if (pending.wide)
+    {
+        if (reg16[pending.reg] != pending.old)
+        {
+            sim_write16(pending.reg, pending.old, reg16[pending.reg]);
+        }
+    }
+    else if ((reg8[pending.reg] != pending.old) || sim_strobe(pending.reg))
+    {
+        sim_write8(pending.reg, pending.old, reg8[pending.reg], pending.rx_vector);
+    }
+}
+
+
+volatile uint8_t * sim_io8(enum sim_reg8 reg)
+{
+    sim_commit();
+    sim_spend(SIM_IO_CYCLES);
+
+    if (reg == SIM_PINB)
+    {
+        // outputs and the ICP1 input
+        reg8[reg] = (reg8[SIM_PORTB] & reg8[SIM_DDRB]) |
+                    ((reg8[SIM_DDRB] & _BV(DDB0)) ? 0 : icp1);
+    }
+
+    pending.valid = 1;
+    pending.wide = 0;
+    pending.reg = reg;
+    pending.old = reg8[reg];
+    pending.rx_vector = (vector != NULL) && (vector == USART_RX_vect);
+
+    return &reg8[reg];
+}
+
+
+volatile uint16_t * sim_io16(enum sim_reg16 reg)
+{
+    sim_commit();
+    sim_spend(SIM_IO_CYCLES);
+
+    pending.valid = 1;
+    pending.wide = 1;
+    pending.reg = reg;
+    pending.old = reg16[reg];
+
+    return &reg16[reg];
+}
+
+
+void sim_cli(void)
+{
+    sim_commit();
+    sim_spend(1);
+    reg8[SIM_SREG] &= ~_BV(SREG_I);
+}
+
+
+void sim_sei(void)
+{
+    sim_commit();
+    sim_spend(1);
+
+    // the instruction after sei runs before a pending interrupt is taken, so
+    // sei then sleep_cpu() wakes on it
+    reg8[SIM_SREG] |= _BV(SREG_I);
+    sei_shadow = 1;
+}
+
+
+//
+// test if an enabled interrupt can still be raised without the host
+//
+static uint8_t sim_can_wake(void)
+{
+    if (timer1_div &&
+        (reg8[SIM_TIMSK1] & (_BV(OCIE1A) | _BV(OCIE1B) | _BV(TOIE1))))
+    {
+        return 1;
+    }
+
+    if ((reg8[SIM_UCSR0B] & _BV(RXCIE0)) && rx_wire_n)
+    {
+        return 1;
+    }
+
+    if ((reg8[SIM_UCSR0B] & (_BV(UDRIE0) | _BV(TXCIE0))) && (tx_busy || tx_full))
+    {
+        return 1;
+    }
+
+    if ((reg8[SIM_SPCR] & _BV(SPIE)) && spi_busy)
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+
+//
+// sleep until an interrupt has been serviced
+//
+void sim_sleep(void)
+{
+    uint32_t taken;
+
+    sim_commit();
+
+    if (!(reg8[SIM_SMCR] & _BV(SE)))
+    {
+        return;
+    }
+
+    if (!(reg8[SIM_SREG] & _BV(SREG_I)))
+    {
+        sim_fatal("sleep with interrupts disabled");
+    }
+
+    sim_spend(0);
+
+    taken = vectors_taken;
+    sim_deliver();
+
+    while (taken == vectors_taken)
+    {
+        uint64_t next;
+
+        usart_rx_stdin();
+
+        if (!sim_can_wake())
+        {
+            if (sim_stdin && (reg8[SIM_UCSR0B] & _BV(RXCIE0)))
+            {
+                // wait for the host
+                struct pollfd fds = { .fd = 0, .events = POLLIN };
+
+                poll(&fds, 1, -1);
+                continue;
+            }
+
+            sim_fatal("sleep with nothing to wake it");
+        }
+
+        next = sim_next_event(UINT64_MAX);
+
+        sim_advance(next);
+    }
+}
+
+
+//
+// let cycles pass as if the core were sleeping
+//
+void sim_run(uint64_t n)
+{
+    sim_commit();
+    sei_shadow = 0;
+    sim_deliver();
+    sim_spend(n);
+}
+
+
+void sim_icp1(uint8_t level)
+{
+    level = (level) ? 1 : 0;
+
+    sim_commit();
+
+    if (level != icp1)
+    {
+        icp1 = level;
+
+        if (level == ((reg8[SIM_TCCR1B] & _BV(ICES1)) ? 1 : 0))
+        {
+            reg16[SIM_ICR1] = reg16[SIM_TCNT1];
+            reg8[SIM_TIFR1] |= _BV(ICF1);
+        }
+    }
+
+    sei_shadow = 0;
+    sim_deliver();
+}
+
+
+//
+// reset state
+//
+__attribute__((constructor))
+static void sim_reset(void)
+{
+    const char * limit = getenv("SIM_CYCLES");
+
+    reg8[SIM_UCSR0A] = _BV(UDRE0);
+    reg8[SIM_UCSR0C] = _BV(UCSZ01) | _BV(UCSZ00);
+
+    if (limit)
+    {
+        cycles_limit = strtoull(limit, NULL, 0);
+    }
+}
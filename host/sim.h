@@ -0,0 +1,137 @@
+#ifndef _SIM_H_
+#define _SIM_H_
+
+#include <stdint.h>
+
+//
+// ATmega328P simulator for host builds
+//
+//  the host headers in this directory stand in for the avr-libc headers so
+//  the firmware sources build unchanged with gcc or clang, every i/o register
+//  is reached through an accessor that advances a simulated clock and applies
+//  the side effects of the previous access
+//
+//  simulated
+//
+//    timer 1 normal mode counting, compare A and B with the OC1A and OC1B
+//    output actions and force output compare, overflow and input capture
+//
+//    the USART transmitter and receiver at the frame time set by UBRR0 and
+//    UCSR0C, and the SPI master at the SPCR and SPSR clock rate
+//
+//    the global interrupt flag, interrupt priority by vector number and sleep
+//
+//  time only passes at register accesses, SIM_IO_CYCLES each, interrupt entry
+//  and exit, and sleep, so runs are exactly repeatable, code between register
+//  accesses takes no time unless it is built with -fsanitize-coverage=trace-pc,
+//  then each basic block run costs SIM_BLOCK_CYCLES, charged at the next
+//  register access, a cost model for comparing code paths rather than a count
+//  of the cycles taken on the target
+//
+//  registers with a write strobe are taken as written at every access, the
+//  firmware never reads them, TIFR1 (write one to clear), PINB (write one to
+//  toggle PORTB), SPDR (start transfer) and UDR0 outside of USART_RX_vect
+//  (transmit), within USART_RX_vect an access of UDR0 is a read
+//
+//  timer 0 and timer 2 registers are plain storage
+//
+#ifndef SIM_IO_CYCLES
+#define SIM_IO_CYCLES 2
+#endif
+
+#ifndef SIM_BLOCK_CYCLES
+// mean cycles of a basic block of avr-gcc -O2 code
+#define SIM_BLOCK_CYCLES 6
+#endif
+
+#ifndef SIM_ISR_CYCLES
+// interrupt response, call and reti
+#define SIM_ISR_CYCLES 10
+#endif
+
+//
+// 8-bit registers
+//
+enum sim_reg8 {
+    SIM_GPIOR0, SIM_GPIOR1, SIM_GPIOR2,
+    SIM_PINB, SIM_DDRB, SIM_PORTB,
+    SIM_PINC, SIM_DDRC, SIM_PORTC,
+    SIM_PIND, SIM_DDRD, SIM_PORTD,
+    SIM_SREG, SIM_SMCR, SIM_PRR, SIM_MCUSR,
+    SIM_EICRA, SIM_EIMSK, SIM_EIFR,
+    SIM_PCICR, SIM_PCIFR, SIM_PCMSK0, SIM_PCMSK1, SIM_PCMSK2,
+    SIM_TCCR0A, SIM_TCCR0B, SIM_TCNT0, SIM_OCR0A, SIM_OCR0B, SIM_TIMSK0, SIM_TIFR0,
+    SIM_TCCR1A, SIM_TCCR1B, SIM_TCCR1C, SIM_TIMSK1, SIM_TIFR1,
+    SIM_TCCR2A, SIM_TCCR2B, SIM_TCNT2, SIM_OCR2A, SIM_OCR2B, SIM_TIMSK2, SIM_TIFR2,
+    SIM_ASSR, SIM_GTCCR,
+    SIM_SPCR, SIM_SPSR, SIM_SPDR,
+    SIM_UCSR0A, SIM_UCSR0B, SIM_UCSR0C, SIM_UDR0,
+    SIM_ACSR, SIM_DIDR0, SIM_DIDR1,
+    SIM_REG8_N
+};
+
+//
+// 16-bit registers
+//
+enum sim_reg16 {
+    SIM_TCNT1, SIM_OCR1A, SIM_OCR1B, SIM_ICR1,
+    SIM_UBRR0,
+    SIM_REG16_N
+};
+
+volatile uint8_t * sim_io8(enum sim_reg8 reg);
+volatile uint16_t * sim_io16(enum sim_reg16 reg);
+
+void sim_cli(void);
+void sim_sei(void);
+void sim_sleep(void);
+
+//
+// simulated time in cpu cycles
+//
+uint64_t sim_cycles(void);
+
+//
+// let cycles pass as if the core were sleeping with interrupts enabled
+//
+void sim_run(uint64_t cycles);
+
+//
+// exit the simulation once cycles have passed, 0 for no limit, also set from
+// the SIM_CYCLES environment variable
+//
+void sim_limit(uint64_t cycles);
+
+//
+// queue bytes for the USART receiver, one frame time apart
+//
+void sim_usart_rx(uint8_t c);
+void sim_usart_rx_str(const char * s);
+
+//
+// feed the host standard input to the USART receiver while sleeping, on by
+// default
+//
+extern uint8_t sim_stdin;
+
+//
+// drive the ICP1 pin
+//
+void sim_icp1(uint8_t level);
+
+//
+// hooks, called with the simulated time of the event
+//
+//  sim_usart_tx_hook - a frame left the USART transmitter, by default the
+//                      byte is written to the host standard output
+//  sim_spi_tx_hook   - a byte was shifted out of the SPI
+//  sim_oc1_hook      - OC1A (channel 0) or OC1B (channel 1) changed level
+//  sim_port_hook     - PORTB (port 0), PORTC (port 1) or PORTD (port 2) was
+//                      written with a new value or toggled
+//
+extern void (* sim_usart_tx_hook)(uint8_t c, uint64_t cycles);
+extern void (* sim_spi_tx_hook)(uint8_t c, uint64_t cycles);
+extern void (* sim_oc1_hook)(uint8_t channel, uint8_t level, uint64_t cycles);
+extern void (* sim_port_hook)(uint8_t port, uint8_t level, uint64_t cycles);
+
+#endif // _SIM_H_
@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+//
+// host standard streams
+//
+static int host_put(char c, FILE * stream)
+{
+    return (write((stream == sim_stderr_stream) ? 2 : 1, &c, 1) == 1) ? 0 : _FDEV_ERR;
+}
+
+
+static int host_get(FILE * stream)
+{
+    char c;
+
+    (void) stream;
+
+    return (read(0, &c, 1) == 1) ? (uint8_t) c : _FDEV_EOF;
+}
+
+
+static FILE host_stdin = FDEV_SETUP_STREAM(NULL, host_get, _FDEV_SETUP_READ);
+static FILE host_stdout = FDEV_SETUP_STREAM(host_put, NULL, _FDEV_SETUP_WRITE);
+static FILE host_stderr = FDEV_SETUP_STREAM(host_put, NULL, _FDEV_SETUP_WRITE);
+
+FILE * sim_stdin_stream = &host_stdin;
+FILE * sim_stdout_stream = &host_stdout;
+FILE * sim_stderr_stream = &host_stderr;
+
+
+int sim_fputc(int c, FILE * stream)
+{
+    if (!stream || !(stream->flags & _FDEV_SETUP_WRITE) ||
+        (stream->put((char) c, stream) != 0))
+    {
+        return EOF;
+    }
+
+    return (uint8_t) c;
+}
+
+
+int sim_fgetc(FILE * stream)
+{
+    int c;
+
+    if (!stream || !(stream->flags & _FDEV_SETUP_READ))
+    {
+        return EOF;
+    }
+
+    c = stream->get(stream);
+
+    return (c < 0) ? EOF : (uint8_t) c;
+}
+
+
+int sim_fputs(const char * s, FILE * stream)
+{
+    while (*s)
+    {
+        if (sim_fputc(*s++, stream) == EOF)
+        {
+            return EOF;
+        }
+    }
+
+    return 0;
+}
+
+
+int sim_puts(const char * s)
+{
+    if (sim_fputs(s, stdout) == EOF)
+    {
+        return EOF;
+    }
+
+    return (sim_fputc('\n', stdout) == EOF) ? EOF : 0;
+}
+
+
+char * sim_fgets(char * s, int size, FILE * stream)
+{
+    int i;
+
+    for (i = 0; i < (size - 1); )
+    {
+        int c = sim_fgetc(stream);
+
+        if (c == EOF)
+        {
+            if (i == 0)
+            {
+                return NULL;
+            }
+
+            break;
+        }
+
+        s[i++] = c;
+
+        if (c == '\n')
+        {
+            break;
+        }
+    }
+
+    s[i] = '\0';
+
+    return s;
+}
+
+
+int sim_putchar(int c)
+{
+    return sim_fputc(c, stdout);
+}
+
+
+int sim_getchar(void)
+{
+    return sim_fgetc(stdin);
+}
+
+
+int sim_vfprintf(FILE * stream, const char * fmt, va_list ap)
+{
+    char buffer[256];
+    char * s = buffer;
+    va_list aq;
+    int n;
+    int i;
+
+    va_copy(aq, ap);
+    n = vsnprintf(buffer, sizeof(buffer), fmt, aq);
+    va_end(aq);
+
+    if (n < 0)
+    {
+        return EOF;
+    }
+
+    if (n >= (int) sizeof(buffer))
+    {
+        if (!(s = malloc(n + 1)))
+        {
+            return EOF;
+        }
+
+        vsnprintf(s, n + 1, fmt, ap);
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        if (sim_fputc(s[i], stream) == EOF)
+        {
+            n = EOF;
+            break;
+        }
+    }
+
+    if (s != buffer)
+    {
+        free(s);
+    }
+
+    return n;
+}
+
+
+int sim_vprintf(const char * fmt, va_list ap)
+{
+    return sim_vfprintf(stdout, fmt, ap);
+}
+
+
+int sim_fprintf(FILE * stream, const char * fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = sim_vfprintf(stream, fmt, ap);
+    va_end(ap);
+
+    return n;
+}
+
+
+int sim_printf(const char * fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = sim_vfprintf(stdout, fmt, ap);
+    va_end(ap);
+
+    return n;
+}
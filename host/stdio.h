@@ -0,0 +1,94 @@
+#ifndef _HOST_STDIO_H_
+#define _HOST_STDIO_H_
+
+//
+// avr-libc standard i/o for host builds
+//
+//  FILE is the avr-libc stream of a put and a get function, set up with
+//  FDEV_SETUP_STREAM(), the standard streams initially write to and read from
+//  the host, the firmware points them at its console, formatting is done by
+//  the host C library
+//
+#include_next <stdio.h>
+
+#include <stdarg.h>
+#include <stdint.h>
+
+struct __file {
+    int (* put)(char c, struct __file * stream);
+    int (* get)(struct __file * stream);
+    uint8_t flags;
+    void * udata;
+};
+
+#define _FDEV_SETUP_READ 1
+#define _FDEV_SETUP_WRITE 2
+#define _FDEV_SETUP_RW (_FDEV_SETUP_READ | _FDEV_SETUP_WRITE)
+
+#define _FDEV_ERR (-1)
+#define _FDEV_EOF (-2)
+
+#define FDEV_SETUP_STREAM(p,g,f) { .put = (p), .get = (g), .flags = (f), .udata = 0 }
+
+#define fdev_set_udata(s,u) do {(s)->udata = (u);} while (0)
+#define fdev_get_udata(s) ((s)->udata)
+
+#undef FILE
+#define FILE struct __file
+
+#undef stdin
+#undef stdout
+#undef stderr
+#define stdin sim_stdin_stream
+#define stdout sim_stdout_stream
+#define stderr sim_stderr_stream
+
+extern FILE * sim_stdin_stream;
+extern FILE * sim_stdout_stream;
+extern FILE * sim_stderr_stream;
+
+#undef printf
+#undef vprintf
+#undef fprintf
+#undef vfprintf
+#undef putchar
+#undef getchar
+#undef puts
+#undef fputs
+#undef fputc
+#undef putc
+#undef fgetc
+#undef getc
+#undef fgets
+#define printf sim_printf
+#define vprintf sim_vprintf
+#define fprintf sim_fprintf
+#define vfprintf sim_vfprintf
+#define putchar sim_putchar
+#define getchar sim_getchar
+#define puts sim_puts
+#define fputs sim_fputs
+#define fputc sim_fputc
+#define putc sim_fputc
+#define fgetc sim_fgetc
+#define getc sim_fgetc
+#define fgets sim_fgets
+
+#define printf_P printf
+#define fprintf_P fprintf
+#define puts_P puts
+#define fputs_P fputs
+
+int sim_printf(const char * fmt, ...);
+int sim_vprintf(const char * fmt, va_list ap);
+int sim_fprintf(FILE * stream, const char * fmt, ...);
+int sim_vfprintf(FILE * stream, const char * fmt, va_list ap);
+int sim_putchar(int c);
+int sim_getchar(void);
+int sim_puts(const char * s);
+int sim_fputs(const char * s, FILE * stream);
+int sim_fputc(int c, FILE * stream);
+int sim_fgetc(FILE * stream);
+char * sim_fgets(char * s, int size, FILE * stream);
+
+#endif // _HOST_STDIO_H_
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "project.h"
+#include "timer.h"
+#include "irqprof.h"
+
+#if IRQPROF
+
+//
+// interrupts disabled window being timed, only one can be open as interrupts
+// are disabled while it is
+//
+static tbtimer_t irqprof_start;
+static uint8_t irqprof_open;
+
+static struct irqprof_stats irqprof_stats;
+
+
+//
+// start timing, called with interrupts just disabled
+//
+void irqprof_begin(void)
+{
+    irqprof_start = TBTCNT;
+    irqprof_open = 1;
+}
+
+
+//
+// stop timing, called with interrupts disabled just before enabling them,
+// does nothing if no window is open
+//
+void irqprof_end(const char * site)
+{
+    tbtimer_t counts;
+    tbtimer_t range;
+    uint8_t bucket;
+
+    if (!irqprof_open)
+    {
+        return;
+    }
+
+    counts = TBTCNT - irqprof_start;
+    irqprof_open = 0;
+
+    // log2 bucket, the last bucket holds everything larger
+    for ( bucket = 0, range = counts;
+          range && (bucket < (IRQPROF_BUCKETS - 1));
+          bucket++, range >>= 1);
+
+    if (irqprof_stats.bucket[bucket] != UINT16_MAX)
+    {
+        irqprof_stats.bucket[bucket]++;
+    }
+
+    if ((irqprof_stats.count == 0) || (counts > irqprof_stats.max))
+    {
+        irqprof_stats.max = counts;
+        irqprof_stats.max_site = site;
+    }
+
+    irqprof_stats.count++;
+}
+
+
+void irqprof_get_stats(struct irqprof_stats * stats)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *stats = irqprof_stats;
+    }
+}
+
+
+void irqprof_clear(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memset(&irqprof_stats, 0, sizeof(irqprof_stats));
+    }
+}
+
+
+//
+// print the longest interrupts disabled window and the histogram on the
+// console, in timebase timer counts
+//
+void irqprof_print(void)
+{
+    struct irqprof_stats stats;
+    uint8_t bucket;
+
+    irqprof_get_stats(&stats);
+
+    printf("irqs off: count %lu max %u", (unsigned long) stats.count, stats.max);
+    if (stats.max_site)
+    {
+        printf(" at ");
+        fputs_P(stats.max_site, stdout);
+    }
+    printf("\n");
+
+    for (bucket = 0; bucket < IRQPROF_BUCKETS; bucket++)
+    {
+        if (stats.bucket[bucket] == 0)
+        {
+            continue;
+        }
+
+        if (bucket < (IRQPROF_BUCKETS - 1))
+        {
+            printf("  <  %5u : %u\n", 1U << bucket, stats.bucket[bucket]);
+        }
+        else
+        {
+            printf("  >= %5u : %u\n", 1U << (bucket - 1), stats.bucket[bucket]);
+        }
+    }
+}
+
+#endif // IRQPROF
@@ -0,0 +1,102 @@
+#ifndef _IRQPROF_H_
+#define _IRQPROF_H_
+
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+
+#ifndef IRQPROF
+// default to no interrupts disabled profiling
+#define IRQPROF 0
+#endif
+
+//
+// interrupts disabled profiler
+//
+//  critical sections entered with interrupts enabled are timed in timebase
+//  timer counts from disabling to re-enabling interrupts, the longest window
+//  and the site that caused it are kept along with a log2 histogram, bucket 0
+//  holds 0 and bucket n holds 2^(n-1) to 2^n-1
+//
+//  IRQPROF_ATOMIC_BLOCK(site) replaces ATOMIC_BLOCK(ATOMIC_RESTORESTATE), a
+//  block nested in another or in an interrupt handler is not timed on its own
+//
+//  irqprof_cli() and irqprof_sei(site) replace a cli() and sei() pair, the
+//  sei() stays the last instruction so a following sleep_cpu() can not miss
+//  a wakeup
+//
+//  sites are program memory strings
+//
+#if IRQPROF
+
+#ifndef IRQPROF_BUCKETS
+#define IRQPROF_BUCKETS 16
+#endif
+
+struct irqprof_stats {
+    uint32_t count;
+    tbtimer_t max;
+    const char * max_site;
+    uint16_t bucket[IRQPROF_BUCKETS];
+};
+
+void irqprof_begin(void);
+void irqprof_end(const char * site);
+void irqprof_get_stats(struct irqprof_stats * stats);
+void irqprof_clear(void);
+void irqprof_print(void);
+
+struct irqprof_block {
+    uint8_t sreg;
+    uint8_t todo;
+    const char * site;
+};
+
+static __inline__ struct irqprof_block irqprof_block_enter(const char * site)
+{
+    struct irqprof_block block = { .sreg = SREG, .todo = 1, .site = site };
+
+    cli();
+
+    if (block.sreg & _BV(SREG_I))
+    {
+        irqprof_begin();
+    }
+
+    return block;
+}
+
+static __inline__ void irqprof_block_exit(struct irqprof_block * block)
+{
+    if (block->sreg & _BV(SREG_I))
+    {
+        irqprof_end(block->site);
+    }
+
+    SREG = block->sreg;
+    __asm__ volatile ("" ::: "memory");
+}
+
+#define IRQPROF_ATOMIC_BLOCK(site)                                             \
+    for (struct irqprof_block __irqprof_block                                  \
+             __attribute__((__cleanup__(irqprof_block_exit))) =                \
+             irqprof_block_enter(PSTR(site));                                  \
+         __irqprof_block.todo;                                                 \
+         __irqprof_block.todo = 0)
+
+#define irqprof_cli() do { cli(); irqprof_begin(); } while (0)
+#define irqprof_sei(site) do { irqprof_end(PSTR(site)); sei(); } while (0)
+
+#else // IRQPROF
+
+#define irqprof_begin() do {} while (0)
+#define irqprof_end(site) do {} while (0)
+
+#define IRQPROF_ATOMIC_BLOCK(site) ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+
+#define irqprof_cli() cli()
+#define irqprof_sei(site) sei()
+
+#endif // IRQPROF
+
+#endif // _IRQPROF_H_
@@ -6,13 +6,14 @@
 #include "timer.h"
 #include "servo.h"
 #include "dds.h"
+#include "console.h"
+#include "sched.h"
 
 #include "mathops.h"
 #include "lerp.h"
 
 extern void timer1_init(void);
 extern void tick_init(void);
-extern void console_init(void);
 
 static struct interpolant percent_to_byte = {
     .x = 0,     // x0
@@ -30,25 +31,18 @@ static struct interpolant degree_to_servo = {
 };
 
 
-int main(void)
+//
+// console task, print the interpolation table then set the servo pulse width
+// from each line read
+//
+static int8_t console_task(struct task * this_task)
 {
-    uint16_t pulse_width = 250;
-
-    uint16_t x;
-    uint16_t y;
-    uint16_t y0;
+    static char iobuffer[32];
+    static uint16_t pulse_width = 250;
+    static uint16_t x;
+    static uint16_t y0;
 
-    // initialize
-    ATOMIC_BLOCK(ATOMIC_FORCEON)
-    {
-        timer1_init();
-        timebase_init();
-        tick_init();
-        servo_init();
-        dds_init();
-        console_init();
-    }
-    // interrupts are enabled
+    TASK_BEGIN(this_task);
 
     printf("Up, up and away!\n");
 
@@ -57,25 +51,35 @@ int main(void)
     // use linear interpolation to translate 0-100% to 0-255
     y0 = percent_to_byte.y;
     for (x = 0; x <= 100; x++) {
+        uint16_t y;
+
+        // one line at a time so other tasks are not held up by the console
+        TASK_WAIT_UNTIL(this_task, TASK_SIGNAL_TX, console_tx_idle());
+
         y = lerp(x, &percent_to_byte);
         printf("%3d : 0x%02x : %02d\n", x, y, y - y0);
         y0 = y;
     }
 
     for (;;) {
-        char iobuffer[32];
-        uint8_t n_io = 0;
+        uint8_t n_io;
 
-        iobuffer[n_io] = '\0';
+        TASK_WAIT_UNTIL(this_task, TASK_SIGNAL_TX, console_tx_idle());
 
         printf("%d\n", pulse_width);
 
         servo_set_mode(SERVO_MODE_ACTIVE, pulse_width);
 
+        // a complete line is ready, getchar does not wait
+        TASK_WAIT_UNTIL(this_task, TASK_SIGNAL_RX, console_rx_ready());
+
+        n_io = 0;
+        iobuffer[n_io] = '\0';
+
         for (;;) {
             int c;
 
-            while ((c = getchar()) == EOF);
+            if ((c = getchar()) == EOF) break;
 
             if (c != '\n') {
                 iobuffer[n_io++] = c;
@@ -87,11 +91,36 @@ int main(void)
             break;
         }
 
+        TASK_WAIT_UNTIL(this_task, TASK_SIGNAL_TX, console_tx_idle());
+
         printf("Input: %s\n", iobuffer);
 
         pulse_width = (uint16_t) strtol(iobuffer, NULL, 0);
     }
 
+    TASK_END(this_task);
+}
+
+
+int main(void)
+{
+    static struct task console_task_struct;
+
+    // initialize
+    ATOMIC_BLOCK(ATOMIC_FORCEON)
+    {
+        timer1_init();
+        timebase_init();
+        tick_init();
+        servo_init();
+        dds_init();
+        console_init();
+    }
+    // interrupts are enabled
+
+    task_start(&console_task_struct, console_task);
+
+    sched_run();
 
 /*
     //        uint32_t frequency; // frequency * 32
@@ -1,11 +1,16 @@
 #ifndef _MATHOPS_H_
 #define _MATHOPS_H_
 
+//
+// arithmetic in AVR assembly, with plain C for host builds
+//
+
 //
 // unsigned divide, 32-bit / 16-bit -> 16-bit
 //
 static inline uint16_t _divu(uint32_t dividend, uint16_t divisor)
 {
+#if defined (__AVR__)
     uint8_t count = 17;
 
     __asm__ __volatile__ (
@@ -39,6 +44,9 @@ static inline uint16_t _divu(uint32_t dividend, uint16_t divisor)
     );
 
     return (uint16_t) dividend;
+#else
+    return (uint16_t) (dividend / divisor);
+#endif
 }
 
 //
@@ -48,6 +56,7 @@ static inline uint16_t _divu(uint32_t dividend, uint16_t divisor)
 //
 static inline uint32_t _ummd32(uint32_t dividend, uint32_t divisor)
 {
+#if defined (__AVR__)
     uint32_t quotient;
     uint8_t count = 33;
 
@@ -93,6 +102,9 @@ static inline uint32_t _ummd32(uint32_t dividend, uint32_t divisor)
     );
 
     return quotient;
+#else
+    return (uint32_t) (((uint64_t) dividend << 32) / divisor);
+#endif
 }
 
 
@@ -101,6 +113,7 @@ static inline uint32_t _ummd32(uint32_t dividend, uint32_t divisor)
 //
 static inline uint32_t _mulu(uint16_t multiplier, uint16_t multiplicand)
 {
+#if defined (__AVR__)
     uint32_t product;
 
     __asm__ __volatile__ (
@@ -136,6 +149,9 @@ static inline uint32_t _mulu(uint16_t multiplier, uint16_t multiplicand)
     );
 
     return product;
+#else
+    return (uint32_t) multiplier * multiplicand;
+#endif
 }
 
 
@@ -57,12 +57,139 @@ static inline uint8_t test_gpflag(int flag)
 //
 // timebase timer, 0, 1 or 2 (only 1 is extensively tested)
 //
+//  the prescaler is 1, 8, 64, 256 or 1024
+//
 #define TBTIMER 1
+
+#ifndef TBTIMER_PRESCALER
 #define TBTIMER_PRESCALER 64
+#endif
 
 //
-// timebase counter size in bits, either 16 or 32
+// timebase counter size in bits, either 16, 32 or 64
+//
+//  with 16 or 32 TIMER_EPOCH extends the timebase to 64 bits for
+//  timebase_now64() and long timer events at the cost of one epoch timer
+//  event per quarter turn of the timebase, 64 makes every tick comparison
+//  64-bit
 //
 #define TBSIZE 32
 
+#ifndef TIMER_EPOCH
+#define TIMER_EPOCH 0
+#endif
+
+//
+// timer event queue, TIMER_QUEUE_LIST, TIMER_QUEUE_WHEEL or TIMER_QUEUE_HEAP
+//
+//  the timing wheel trades about 1 KiB of RAM for constant time scheduling
+//  and cancellation, the heap scales as O(log n) with TIMER_HEAP_SIZE
+//  pointers of RAM and moves timer events with reschedule_timer_event()
+//
+#ifndef TIMER_QUEUE
+#define TIMER_QUEUE TIMER_QUEUE_LIST
+#endif
+
+//
+// doubly link the timer event list, constant time cancel at the cost of one
+// pointer per timer event
+//
+#ifndef TIMER_EVENT_PREV
+#define TIMER_EVENT_PREV 0
+#endif
+
+//
+// let timer events with slack expire late to share interrupts, see
+// set_timer_slack() and timer_get_stats()
+//
+#ifndef TIMER_SLACK
+#define TIMER_SLACK 0
+#endif
+
+//
+// run handlers of timer events flagged TIMER_FLAG_DEFERRED outside the compare
+// interrupt, from timer_run_pending() in the main loop or the interrupt tail
+//
+#ifndef TIMER_DEFERRED
+#define TIMER_DEFERRED 0
+#endif
+
+//
+// record the dispatch lateness and handler run time of timer events in log2
+// histograms, see timer_get_latency() and timer_print_latency()
+//
+#ifndef TIMER_HISTOGRAM
+#define TIMER_HISTOGRAM 0
+#endif
+
+//
+// time the interrupts disabled critical sections, see irqprof.h
+//
+#ifndef IRQPROF
+#define IRQPROF 0
+#endif
+
+//
+// let timer events drive the timebase compare output pin in hardware, see
+// timer_output_init(), with timer 1 compare B this is OC1B (PB2) which is
+// the DDS FQ_UD so the DDS does not build with it, the tick speaker moves there
+// from PD4
+//
+#ifndef TIMER_OUTPUT
+#define TIMER_OUTPUT 0
+#endif
+
+//
+// dispatch timer events due together by priority, see set_timer_priority(),
+// and with a TIMER_BUDGET in ticks leave those below TIMER_PRIORITY_CRITICAL
+// for a later pass once the budget is spent
+//
+#ifndef TIMER_PRIORITY
+#define TIMER_PRIORITY 0
+#endif
+
+//
+// servo channel pins, port letter and pin mask for up to three ports, see
+// servo.h, port B also carries the DDS and port D the console and the tick
+// speaker
+//
+#ifndef SERVO_PORT0
+#define SERVO_PORT0 B
+#endif
+
+#ifndef SERVO_PORT0_PINS
+#define SERVO_PORT0_PINS _BV(PORTB1)
+#endif
+
+#ifndef SERVO_PORT1
+#define SERVO_PORT1 C
+#endif
+
+#ifndef SERVO_PORT1_PINS
+#define SERVO_PORT1_PINS 0
+#endif
+
+#ifndef SERVO_PORT2
+#define SERVO_PORT2 D
+#endif
+
+#ifndef SERVO_PORT2_PINS
+#define SERVO_PORT2_PINS 0
+#endif
+
+//
+// average servo motion profiles over 2^SERVO_SCURVE frames for S-curve ramps,
+// 0 for trapezoidal, costs 2^SERVO_SCURVE words of RAM per channel
+//
+#ifndef SERVO_SCURVE
+#define SERVO_SCURVE 0
+#endif
+
+//
+// DDS frames queued for the SPI interrupt, a power of two, see dds_queue()
+//
+#ifndef DDS_QUEUE_SIZE
+#define DDS_QUEUE_SIZE 4
+#endif
+
 #endif // _PROJECT_H_
@@ -0,0 +1,173 @@
+#include <stddef.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#include "project.h"
+#include "timer.h"
+#include "sched.h"
+#include "irqprof.h"
+
+//
+// started tasks, run in the order started
+//
+static struct task * task_list;
+
+
+//
+// task timer event handler, wake the task
+//
+static int8_t task_timer_handler(struct timer_event * this_timer_event)
+{
+    struct task * this_task = (struct task *) ((uint8_t *) this_timer_event - offsetof(struct task, timer_event));
+
+    task_signal(this_task, TASK_SIGNAL_TIMER);
+
+    return 0;
+}
+
+
+//
+// add a task to the end of the task list, it first runs on the next pass of
+// the scheduler
+//
+void task_start(struct task * this_task, int8_t (* run)(struct task * this_task))
+{
+    struct task ** tthis_task;
+
+    this_task->next = NULL;
+    this_task->run = run;
+    this_task->state = 0;
+    this_task->signals = 0;
+    this_task->wait = 0;
+
+    // the task timer starts at now for TASK_SLEEP_PERIOD()
+    init_timer_event(&this_task->timer_event, timebase_now(), task_timer_handler);
+
+    for ( tthis_task  = &task_list;
+         *tthis_task != NULL;
+          tthis_task  = &((*tthis_task)->next));
+
+    *tthis_task = this_task;
+}
+
+
+//
+// send signals to a task, may be called from an interrupt handler
+//
+void task_signal(struct task * this_task, uint8_t signals)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        this_task->signals |= signals;
+    }
+}
+
+
+//
+// schedule again a task timer the timer queue was full for, the timer event
+// is expired with its tbtick still ahead, returns -1 if the queue is still
+// full, see TASK_SLEEP()
+//
+int8_t task_sleep_retry(struct task * this_task)
+{
+    struct timer_event * this_timer_event = &this_task->timer_event;
+    int8_t rc = 0;
+
+    if (timer_is_expired(this_timer_event) &&
+        ((tbtick_st) (this_timer_event->tbtick - timebase_now()) > 0))
+    {
+        rc = reschedule_timer_event(this_timer_event, 0, this_timer_event);
+    }
+
+    return rc;
+}
+
+
+//
+// send signals to every task waiting for them, may be called from an
+// interrupt handler
+//
+void sched_broadcast(uint8_t signals)
+{
+    struct task * this_task;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (this_task = task_list; this_task != NULL; this_task = this_task->next)
+        {
+            if (this_task->wait & signals)
+            {
+                this_task->signals |= signals;
+            }
+        }
+    }
+}
+
+
+//
+// test if a task can run, a task can run when it is not waiting or one of the
+// signals it waits for has been sent, called with interrupts disabled
+//
+static inline uint8_t task_runnable(struct task * this_task)
+{
+    return !this_task->wait || (this_task->signals & this_task->wait);
+}
+
+
+//
+// run the tasks, never returns
+//
+void sched_run(void)
+{
+    for (;;)
+    {
+        struct task ** tthis_task;
+        struct task * this_task;
+
+        for (tthis_task = &task_list; (this_task = *tthis_task) != NULL; )
+        {
+            uint8_t runnable;
+
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                runnable = task_runnable(this_task);
+
+                if (runnable)
+                {
+                    this_task->signals = 0;
+                    this_task->wait = 0;
+                }
+            }
+
+            if (runnable && (this_task->run(this_task) == TASK_EXITED))
+            {
+                // remove exited task
+                cancel_timer_event(&this_task->timer_event);
+                *tthis_task = this_task->next;
+                continue;
+            }
+
+            tthis_task = &this_task->next;
+        }
+
+        // sleep if no task can run
+        irqprof_cli();
+
+        for (this_task = task_list; this_task != NULL; this_task = this_task->next)
+        {
+            if (task_runnable(this_task))
+            {
+                break;
+            }
+        }
+
+        if (this_task)
+        {
+            irqprof_sei("sched_run");
+        }
+        else
+        {
+            timer_idle();
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+//
+// cooperative task scheduler
+//
+//  a task is a protothread, a function re-entered from the top each time the
+//  task runs and resumed at the wait it last returned from, tasks share the
+//  one stack so local variables are not kept across a wait
+//
+//  a waiting task names the signals that wake it, signals are sent by
+//  interrupt handlers and other tasks with task_signal() or sched_broadcast()
+//  and are latched so a signal sent between a task testing its condition and
+//  returning is not lost
+//
+//  when no task can run the core sleeps in timer_idle() until an interrupt
+//
+struct task {
+    struct task * next;
+    int8_t (* run)(struct task * this_task);
+    struct timer_event timer_event;
+    uint16_t state;
+    volatile uint8_t signals;
+    volatile uint8_t wait;
+};
+
+//
+// task signals
+//
+//  TASK_SIGNAL_TIMER - the task timer event expired, see TASK_SLEEP()
+//  TASK_SIGNAL_RX    - console input is ready, see console_rx_ready()
+//  TASK_SIGNAL_TX    - console output buffer drained, see console_tx_idle()
+//
+//  the remaining signals are free for use between tasks
+//
+#define TASK_SIGNAL_TIMER _BV(0)
+#define TASK_SIGNAL_RX _BV(1)
+#define TASK_SIGNAL_TX _BV(2)
+#define TASK_SIGNAL_USER _BV(3)
+
+//
+// task run function return values
+//
+#define TASK_WAITING 0
+#define TASK_EXITED 1
+
+//
+// protothread macros, a task run function is bracketed by TASK_BEGIN() and
+// TASK_END(), may not use switch statements across a wait and may have no
+// more than one wait on a line
+//
+#define TASK_BEGIN(t) switch ((t)->state) { case 0:
+
+#define TASK_END(t) } (t)->state = 0; return TASK_EXITED
+
+//
+// wait for signals until cond is true, the wait is set before cond is tested
+// so a signal sent once cond has been found false wakes the task
+//
+#define TASK_WAIT_UNTIL(t,sig,cond)                                            \
+    do {                                                                       \
+        (t)->state = __LINE__; case __LINE__:                                  \
+        task_wait((t), (sig));                                                 \
+        if (!(cond)) return TASK_WAITING;                                      \
+        task_ready(t);                                                         \
+    } while (0)
+
+//
+// let the other tasks run
+//
+#define TASK_YIELD(t)                                                          \
+    do {                                                                       \
+        (t)->state = __LINE__;                                                 \
+        return TASK_WAITING; case __LINE__:;                                   \
+    } while (0)
+
+//
+// sleep for ticks from now, or ticks from the last wakeup of the task timer,
+// the task start for the first, so a periodic task does not drift
+//
+// when the timer queue is full the task timer is left expired with its
+// tbtick ahead, the task then stays runnable and retries on each pass of the
+// scheduler until the queue takes it or its tbtick has passed
+//
+#define _TASK_SLEEP(t,ticks,ref)                                               \
+    do {                                                                       \
+        reschedule_timer_event(&(t)->timer_event, (ticks), (ref));             \
+        (t)->state = __LINE__; case __LINE__:                                  \
+        if (task_sleep_retry(t) < 0) return TASK_WAITING;                      \
+        task_wait((t), TASK_SIGNAL_TIMER);                                     \
+        if (!timer_is_expired(&(t)->timer_event)) return TASK_WAITING;         \
+        task_ready(t);                                                         \
+    } while (0)
+
+#define TASK_SLEEP(t,ticks) _TASK_SLEEP((t), (ticks), NULL)
+
+#define TASK_SLEEP_PERIOD(t,ticks) _TASK_SLEEP((t), (ticks), &(t)->timer_event)
+
+//
+// mark a task waiting for or no longer waiting for signals
+//
+#define task_wait(t,sig) do {(t)->wait = (sig);} while (0)
+#define task_ready(t) do {(t)->wait = 0;} while (0)
+
+void task_start(struct task * this_task,
+                int8_t (* run)(struct task * this_task));
+void task_signal(struct task * this_task, uint8_t signals);
+int8_t task_sleep_retry(struct task * this_task);
+void sched_broadcast(uint8_t signals);
+void sched_run(void);
+
+#endif // _SCHED_H_
@@ -1,12 +1,11 @@
+#include <string.h>
+#include <avr/interrupt.h>
 #include <util/atomic.h>
 
 #include "project.h"
 #include "timer.h"
 #include "servo.h"
-
-uint8_t servo_mode;
-uint16_t servo_pulse;
-
+#include "irqprof.h"
 
 //
 // The SERVO (Regulator Control) signal of the alternator is an active low input
@@ -32,98 +31,585 @@ uint16_t servo_pulse;
 //
 
 
+//
+// multiplexed servo channels
+//
+//  every channel is driven from the compare A interrupt of timer 1, a frame
+//  starts each SERVO_PERIOD with the pins of the active channels set and each
+//  pin is cleared at the end of its pulse, channels ending together share an
+//  edge
+//
+//  the channels are sorted by pulse width once per frame into an edge
+//  schedule of pin masks, built with interrupts enabled after the last edge
+//  of a frame into the schedule not in use and taken at the next frame start,
+//  an edge interrupt only writes the pin masks of the edge and loads the
+//  compare for the next
+//
+//  edges are made in software, late by the interrupt latency, and an edge
+//  passed before its compare is written is made at once
+//
+// motion profiles
+//
+//  a channel set with servo_move() ramps to its pulse width target with a
+//  trapezoidal velocity profile, advanced once per frame as the frame is
+//  built, positions are in 1/256 tick and the velocity is kept a multiple of
+//  the acceleration so the distance to stop is a running sum, each frame takes
+//  only adds and compares
+//
+//  the velocity and acceleration limits are taken when the channel is at
+//  rest, a new target is taken at once and a target behind a moving channel
+//  is reached by stopping and reversing
+//
+//  with SERVO_SCURVE the profile is averaged over the last 2^SERVO_SCURVE
+//  frames, limiting the jerk for an S-curve ramp at the cost of the same
+//  delay
+//
+// sub-tick widths
+//
+//  the pulse width of a frame is a whole number of ticks, the fraction of the
+//  position is added to an accumulator each frame and its carry lengthens
+//  the pulse by a tick, the error is fed forward so the average width over
+//  successive frames resolves 1/256 tick without a faster prescaler, see
+//  servo_set_fine()
+//
+// setpoint handoff
+//
+//  each channel has two setpoint slots and the index of the one published,
+//  a setpoint is written to the other slot, then published by writing the
+//  index, a single byte store, the frame build reads only the published slot
+//  and cannot be interrupted by a writer, so setpoints are never torn and
+//  are set without masking interrupts, two writers of one channel would share
+//  the unpublished slot so a channel takes one writer at a time, see servo.h
+//
+#define _SERVO_JOIN2(a,b) a##b
+#define _SERVO_PORT(a) _SERVO_JOIN2(PORT,a)
+#define _SERVO_DDR(a) _SERVO_JOIN2(DDR,a)
+
+#define SERVO_PORTS 3
+
+// next edge at frame start
+#define SERVO_EDGE_START 0xff
+
+struct servo_channel {
+    // setpoint
+    uint16_t target;
+    uint8_t fraction;
+    uint16_t set_velocity;
+    uint16_t set_acceleration;
+    uint8_t mode;
+
+    // motion profile, in 1/256 tick
+    uint32_t position;
+    uint32_t brake;
+    uint16_t velocity;
+    uint16_t velocity_max;
+    uint16_t acceleration;
+    uint8_t reverse;
+#if SERVO_SCURVE
+    uint32_t sum;
+    uint16_t history[1 << SERVO_SCURVE];
+#endif
+
+    // pulse width this frame and the fraction of a tick carried
+    uint16_t pulse;
+    uint8_t dither;
+
+    uint8_t port;
+    uint8_t pin;
+};
+
+struct servo_setpoint {
+    uint16_t pulse;
+    uint16_t velocity;
+    uint16_t acceleration;
+    uint8_t fraction;
+    uint8_t mode;
+};
+
+struct servo_edge {
+    // ticks from the frame start
+    uint16_t offset;
+    uint8_t pins[SERVO_PORTS];
+};
+
+struct servo_frame {
+    uint8_t rise[SERVO_PORTS];
+    uint8_t edges;
+    struct servo_edge edge[SERVO_CHANNELS];
+};
+
+static const uint8_t servo_port_pins[SERVO_PORTS] = {
+    SERVO_PORT0_PINS, SERVO_PORT1_PINS, SERVO_PORT2_PINS
+};
+
+// setpoints, the published slot is taken once per frame
+static volatile struct servo_setpoint servo_setpoint[SERVO_CHANNELS][2];
+static volatile uint8_t servo_published[SERVO_CHANNELS];
+
 // edge ISR variables
-uint8_t new_servo_mode;
-uint16_t new_servo_pulse;
-uint16_t servo_cycle_start;
+static struct servo_channel servo_channel[SERVO_CHANNELS];
+static uint8_t servo_order[SERVO_CHANNELS];
+static struct servo_frame servo_frame[2];
+static uint8_t servo_active;
+static volatile uint8_t servo_ready;
+static uint8_t servo_building;
+static uint8_t servo_edge;
+static uint16_t servo_frame_start;
+#if SERVO_SCURVE
+static uint8_t servo_history;
+#endif
 
 
-//
-// the active high SERVO pulse in considered to have a start (the rising edge)
-// and end (the falling edge) the start of the SERVO pulse always occurs at the
-// start of the SERVO cycle
-//
-#define is_servo_cycle_start() test_bit(GPIOR0, 2)
-#define set_servo_cycle_start() reg_set_bit(GPIOR0, 2)
-#define clr_servo_cycle_start() reg_clear_bit(GPIOR0, 2)
+static inline void servo_pins_set(const uint8_t * pins)
+{
+#if SERVO_PORT0_PINS
+    _SERVO_PORT(SERVO_PORT0) |= pins[0];
+#endif
+#if SERVO_PORT1_PINS
+    _SERVO_PORT(SERVO_PORT1) |= pins[1];
+#endif
+#if SERVO_PORT2_PINS
+    _SERVO_PORT(SERVO_PORT2) |= pins[2];
+#endif
+}
+
+
+static inline void servo_pins_clear(const uint8_t * pins)
+{
+#if SERVO_PORT0_PINS
+    _SERVO_PORT(SERVO_PORT0) &= ~pins[0];
+#endif
+#if SERVO_PORT1_PINS
+    _SERVO_PORT(SERVO_PORT1) &= ~pins[1];
+#endif
+#if SERVO_PORT2_PINS
+    _SERVO_PORT(SERVO_PORT2) &= ~pins[2];
+#endif
+}
 
 
 void servo_init(void)
 {
-    // COM1A[1:0]=11b, set OC1A high on compare match
-    TCCR1A |= _BV(COM1A1);
-    TCCR1A |= _BV(COM1A0);
+    uint8_t channel = 0;
+    uint8_t port;
+    uint8_t pin;
+
+    // number the channels in pin order
+    for (port = 0; port < SERVO_PORTS; port++)
+    {
+        for (pin = 1; pin; pin <<= 1)
+        {
+            if (servo_port_pins[port] & pin)
+            {
+                servo_channel[channel].port = port;
+                servo_channel[channel].pin = pin;
+                servo_order[channel] = channel;
 
-    // force compare match, set OC1A high
-    TCCR1C |= _BV(FOC1A);
+                // set the initial SERVO mode and count
+                servo_setpoint[channel][0].mode = SERVO_MODE_OFF;
+                servo_setpoint[channel][0].pulse = SERVO_PULSE_LOW_LIMIT;
+                servo_published[channel] = 0;
+                servo_channel[channel].position = (uint32_t) SERVO_PULSE_LOW_LIMIT << 8;
 
-    // output high, pull-up on
-    PORTB |= _BV(PORTB1);
+                channel++;
+            }
+        }
+    }
+
+    // outputs low
+    servo_pins_clear(servo_port_pins);
 
     // output enable
-    DDRB |= _BV(DDB1);
+#if SERVO_PORT0_PINS
+    _SERVO_DDR(SERVO_PORT0) |= SERVO_PORT0_PINS;
+#endif
+#if SERVO_PORT1_PINS
+    _SERVO_DDR(SERVO_PORT1) |= SERVO_PORT1_PINS;
+#endif
+#if SERVO_PORT2_PINS
+    _SERVO_DDR(SERVO_PORT2) |= SERVO_PORT2_PINS;
+#endif
 
-    // set the initial SERVO mode and count
-    servo_mode = new_servo_mode = SERVO_MODE_OFF;
-    servo_pulse = new_servo_pulse = SERVO_PULSE_LOW_LIMIT;
-    set_servo_cycle_start();
+    // the first frame is empty, the setpoints are taken at its end
+    servo_edge = SERVO_EDGE_START;
 
     // set first cycle interrupt
-    servo_cycle_start = TCNT1 + SERVO_PERIOD;
-    OCR1A = servo_cycle_start;
+    servo_frame_start = TCNT1 + SERVO_PERIOD;
+    OCR1A = servo_frame_start;
 
     // clear timer compare A interrupt
-    TIFR1 |= _BV(OCF1A);
+    TIFR1 = _BV(OCF1A);
 
     // enable timer compare A interrupt
     TIMSK1 |= _BV(OCIE1A);
 }
 
 
-void servo_set_mode(uint8_t mode, uint16_t pulse)
+//
+// the setpoint slot not published, a copy of the published setpoint
+//
+static volatile struct servo_setpoint * servo_setpoint_next(uint8_t channel)
+{
+    uint8_t slot = servo_published[channel];
+    volatile struct servo_setpoint * next = &servo_setpoint[channel][slot ^ 1];
+
+    *next = servo_setpoint[channel][slot];
+
+    return next;
+}
+
+
+//
+// publish the setpoint slot written
+//
+static void servo_setpoint_publish(uint8_t channel)
+{
+    servo_published[channel] ^= 1;
+}
+
+
+void servo_set(uint8_t channel, uint8_t mode, uint16_t pulse)
 {
+    volatile struct servo_setpoint * next = servo_setpoint_next(channel);
+
 //    pulse =  (SERVO_PULSE_HIGH_LIMIT < pulse) ? SERVO_PULSE_HIGH_LIMIT :
 //            ((SERVO_PULSE_LOW_LIMIT  > pulse) ? SERVO_PULSE_LOW_LIMIT  : pulse);
 
-    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    next->mode = mode;
+
+    if (SERVO_MODE_ACTIVE == mode)
+    {
+        next->pulse = pulse;
+        next->fraction = 0;
+        next->velocity = 0;
+    }
+
+    servo_setpoint_publish(channel);
+}
+
+
+//
+// set a channel in 1/16 tick, see SERVO_FINE_FROM_NS(), the fraction is
+// dithered over successive frames
+//
+void servo_set_fine(uint8_t channel, uint8_t mode, uint32_t pulse)
+{
+    volatile struct servo_setpoint * next = servo_setpoint_next(channel);
+
+    next->mode = mode;
+
+    if (SERVO_MODE_ACTIVE == mode)
+    {
+        next->pulse = pulse >> 4;
+        next->fraction = (uint8_t) (pulse << 4);
+        next->velocity = 0;
+    }
+
+    servo_setpoint_publish(channel);
+}
+
+
+//
+// ramp a channel to a pulse width, velocity and acceleration in 1/256 tick
+// per frame and per frame squared, see SERVO_VELOCITY() and
+// SERVO_ACCELERATION(), a velocity of 0 sets the pulse width at once
+//
+void servo_move(uint8_t channel, uint16_t pulse, uint16_t velocity, uint16_t acceleration)
+{
+    volatile struct servo_setpoint * next;
+
+    if ((acceleration == 0) || (acceleration > velocity))
+    {
+        acceleration = velocity;
+    }
+
+    if (acceleration)
+    {
+        // a whole number of acceleration steps
+        velocity -= velocity % acceleration;
+    }
+
+    next = servo_setpoint_next(channel);
+
+    next->mode = SERVO_MODE_ACTIVE;
+    next->pulse = pulse;
+    next->fraction = 0;
+    next->velocity = velocity;
+    next->acceleration = acceleration;
+
+    servo_setpoint_publish(channel);
+}
+
+
+//
+// advance the motion profile of a channel by one frame
+//
+static void servo_profile(struct servo_channel * this_channel)
+{
+    uint32_t target = ((uint32_t) this_channel->target << 8) | this_channel->fraction;
+    uint16_t velocity = this_channel->velocity;
+    uint16_t acceleration;
+    uint16_t last;
+    int32_t distance;
+
+    if (!this_channel->set_velocity)
+    {
+        // no ramp
+        this_channel->position = target;
+        this_channel->velocity = 0;
+        this_channel->brake = 0;
+
+        return;
+    }
+
+    if (!velocity)
+    {
+        // at rest, take the limits
+        this_channel->velocity_max = this_channel->set_velocity;
+        this_channel->acceleration = this_channel->set_acceleration;
+
+        if (this_channel->position == target)
+        {
+            return;
+        }
+
+        this_channel->reverse = (target < this_channel->position);
+    }
+
+    acceleration = this_channel->acceleration;
+    last = velocity;
+
+    distance = (this_channel->reverse) ? (int32_t) (this_channel->position - target) :
+                                         (int32_t) (target - this_channel->position);
+
+    if ((distance >= 0) &&
+        (velocity < this_channel->velocity_max) &&
+        ((uint32_t) distance >= this_channel->brake + 2UL * velocity + acceleration))
+    {
+        // accelerate
+        this_channel->brake += velocity;
+        velocity += acceleration;
+    }
+    else if (velocity &&
+             ((distance < 0) || ((uint32_t) distance < this_channel->brake + velocity)))
+    {
+        // decelerate, past the target or within stopping distance
+        velocity -= acceleration;
+        this_channel->brake -= velocity;
+    }
+
+    if ((distance >= 0) &&
+        ((uint32_t) distance <= velocity) &&
+        (velocity <= acceleration) &&
+        ((uint32_t) distance + acceleration >= last))
+    {
+        // arrive, within the acceleration limit
+        velocity = 0;
+        this_channel->brake = 0;
+        this_channel->position = target;
+    }
+    else if (velocity)
+    {
+        this_channel->position += (this_channel->reverse) ? -(int32_t) velocity : (int32_t) velocity;
+    }
+    else if (distance >= 0)
+    {
+        // less than one acceleration step left
+        this_channel->position = target;
+    }
+
+    this_channel->velocity = velocity;
+}
+
+
+//
+// build the edge schedule of the next frame from the setpoints, called from
+// the compare interrupt after the last edge of a frame
+//
+static void servo_frame_build(void)
+{
+    struct servo_frame * frame;
+    uint8_t i;
+    uint8_t j;
+
+    // take the published setpoints
+    for (i = 0; i < SERVO_CHANNELS; i++)
+    {
+        volatile struct servo_setpoint * setpoint = &servo_setpoint[i][servo_published[i]];
+
+        servo_channel[i].mode = setpoint->mode;
+        servo_channel[i].target = setpoint->pulse;
+        servo_channel[i].fraction = setpoint->fraction;
+        servo_channel[i].set_velocity = setpoint->velocity;
+        servo_channel[i].set_acceleration = setpoint->acceleration;
+    }
+
+    // the interrupt is timed from its entry to here
+    irqprof_end(PSTR("servo_frame_build"));
+
+    NONATOMIC_BLOCK(NONATOMIC_RESTORESTATE)
     {
-        new_servo_mode = mode;
+#if SERVO_SCURVE
+        servo_history = (servo_history + 1) & ((1 << SERVO_SCURVE) - 1);
+#endif
+
+        for (i = 0; i < SERVO_CHANNELS; i++)
+        {
+            struct servo_channel * this_channel = &servo_channel[i];
+            uint32_t position;
+            uint16_t dither;
+
+            servo_profile(this_channel);
+
+            position = this_channel->position;
+
+#if SERVO_SCURVE
+            if (!this_channel->set_velocity)
+            {
+                // no ramp, fill the history
+                uint16_t pulse = position >> 8;
+
+                if (this_channel->sum != ((uint32_t) pulse << SERVO_SCURVE))
+                {
+                    for (j = 0; j < (1 << SERVO_SCURVE); j++)
+                    {
+                        this_channel->history[j] = pulse;
+                    }
+
+                    this_channel->sum = (uint32_t) pulse << SERVO_SCURVE;
+                }
+            }
+            else
+            {
+                this_channel->sum += (position >> 8) - this_channel->history[servo_history];
+                this_channel->history[servo_history] = position >> 8;
+
+                position = this_channel->sum << (8 - SERVO_SCURVE);
+            }
+#endif
+
+            // whole ticks, the fraction is carried from frame to frame so the
+            // average width keeps it
+            dither = this_channel->dither + (uint8_t) position;
+            this_channel->dither = dither;
+
+            this_channel->pulse = (position >> 8) + (dither >> 8);
+        }
+
+        // insertion sort by pulse width from the order of the last frame, one
+        // pass if no channel has passed another
+        for (i = 1; i < SERVO_CHANNELS; i++)
+        {
+            uint8_t channel = servo_order[i];
+            uint16_t pulse = servo_channel[channel].pulse;
+
+            for (j = i; (j > 0) && (servo_channel[servo_order[j - 1]].pulse > pulse); j--)
+            {
+                servo_order[j] = servo_order[j - 1];
+            }
+
+            servo_order[j] = channel;
+        }
+
+        frame = &servo_frame[servo_active ^ 1];
+
+        memset(frame->rise, 0, sizeof(frame->rise));
+        frame->edges = 0;
+
+        for (i = 0; i < SERVO_CHANNELS; i++)
+        {
+            struct servo_channel * this_channel = &servo_channel[servo_order[i]];
+            struct servo_edge * edge = &frame->edge[frame->edges];
 
-        if (SERVO_MODE_ACTIVE == new_servo_mode) new_servo_pulse = pulse;
+            if (SERVO_MODE_ACTIVE != this_channel->mode)
+            {
+                continue;
+            }
+
+            if (frame->edges && (edge[-1].offset == this_channel->pulse))
+            {
+                // share the edge of the last channel
+                edge--;
+            }
+            else
+            {
+                edge->offset = this_channel->pulse;
+                memset(edge->pins, 0, sizeof(edge->pins));
+                frame->edges++;
+            }
+
+            frame->rise[this_channel->port] |= this_channel->pin;
+            edge->pins[this_channel->port] |= this_channel->pin;
+        }
     }
+
+    // disabled again until the interrupt returns
+    irqprof_begin();
+
+    servo_ready = 1;
 }
 
 
 ISR(TIMER1_COMPA_vect)
 {
-    if (is_servo_cycle_start())
+    struct servo_frame * frame = &servo_frame[servo_active];
+    uint16_t ocr;
+
+    irqprof_begin();
+
+    // OCR1A writes share the timebase TEMP register
+    timebase_touch();
+
+    for (;;)
     {
-        if (SERVO_MODE_ACTIVE == servo_mode)
+        if (SERVO_EDGE_START == servo_edge)
         {
-            clr_servo_cycle_start();
-            TCCR1A &= ~_BV(COM1A0);
-            OCR1A = servo_cycle_start + servo_pulse;
+            if (servo_ready)
+            {
+                // take the next frame
+                servo_active ^= 1;
+                servo_ready = 0;
+                frame = &servo_frame[servo_active];
+            }
 
-            servo_cycle_start += SERVO_PERIOD;
-            servo_mode = new_servo_mode;
-            servo_pulse = new_servo_pulse;
+            servo_pins_set(frame->rise);
+            servo_edge = 0;
+        }
+        else
+        {
+            servo_pins_clear(frame->edge[servo_edge].pins);
+            servo_edge++;
+        }
 
-            return;
+        if (servo_edge < frame->edges)
+        {
+            ocr = servo_frame_start + frame->edge[servo_edge].offset;
         }
         else
         {
-            servo_cycle_start += SERVO_PERIOD;
-            servo_mode = new_servo_mode;
-            servo_pulse = new_servo_pulse;
+            // frame done, the next starts one period on
+            servo_edge = SERVO_EDGE_START;
+            servo_frame_start += SERVO_PERIOD;
+            ocr = servo_frame_start;
+        }
+
+        OCR1A = ocr;
+
+        if ((int16_t) (TCNT1 - ocr) < 0)
+        {
+            break;
         }
+
+        // passed before it was written, make it now
+        TIFR1 = _BV(OCF1A);
     }
-    else
-        set_servo_cycle_start();
 
-    if (SERVO_MODE_OFF == servo_mode)
-        TCCR1A &= ~_BV(COM1A0);
-    else
-        TCCR1A |= _BV(COM1A0);
+    if ((SERVO_EDGE_START == servo_edge) && !servo_building)
+    {
+        servo_building = 1;
+        servo_frame_build();
+        servo_building = 0;
+    }
 
-    OCR1A = servo_cycle_start;
+    irqprof_end(PSTR("TIMER1_COMPA_vect"));
 }
@@ -8,14 +8,65 @@
 // servo timing
 #define SERVO_FREQ 100L
 
-#define SERVO_PERIOD (F_CPU / (SERVO_FREQ * TBTIMER_PRESCALER))
+#define SERVO_PERIOD TBPERIOD_FROM_HZ(SERVO_FREQ)
 
 #define SERVO_PULSE_LOW_LIMIT (SERVO_PERIOD * 5L / 100L) // 5%
 #define SERVO_PULSE_HIGH_LIMIT (SERVO_PERIOD - SERVO_PULSE_LOW_LIMIT) // 95%
 
-#define SERVO_COUNTS_PER_MS (F_CPU / (TBTIMER_PRESCALER * 1000L))
+#define SERVO_COUNTS_PER_MS TBTICKS_FROM_MS(1)
+
+_Static_assert(SERVO_PERIOD < 65536L, "SERVO_PERIOD does not fit timer 1.");
+
+//
+// servo channel pins
+//
+//  a servo channel is a pin of SERVO_PORT0_PINS on port SERVO_PORT0,
+//  SERVO_PORT1_PINS on port SERVO_PORT1 or SERVO_PORT2_PINS on port
+//  SERVO_PORT2, numbered in pin order from port 0, the ports are given by
+//  letter, the defaults are in project.h
+//
+#define _SERVO_BITS(a) ((((a) >> 0) & 1) + (((a) >> 1) & 1) + (((a) >> 2) & 1) + (((a) >> 3) & 1) + \
+                        (((a) >> 4) & 1) + (((a) >> 5) & 1) + (((a) >> 6) & 1) + (((a) >> 7) & 1))
+
+#define SERVO_CHANNELS (_SERVO_BITS(SERVO_PORT0_PINS) + _SERVO_BITS(SERVO_PORT1_PINS) + _SERVO_BITS(SERVO_PORT2_PINS))
+
+_Static_assert(SERVO_CHANNELS > 0, "No servo channel pins.");
+
+//
+// average the motion profiles over 2^SERVO_SCURVE frames for S-curve ramps,
+// 0 for trapezoidal, the default is in project.h
+//
+#if SERVO_SCURVE > 8
+#error "SERVO_SCURVE must be 8 or less."
+#endif
+
+//
+// servo_set_fine() pulse width, 1/16 tick, from nanoseconds
+//
+#define SERVO_FINE_FROM_NS(a) _TBCONV(uint32_t, a, F_CPU * 16UL, TBTIMER_PRESCALER * 1000000000ULL)
+
+//
+// motion profile limits from ticks per second and ticks per second squared to
+// 1/256 tick per frame and per frame squared, see servo_move()
+//
+#define SERVO_VELOCITY(a) ((uint16_t) (((uint32_t) (a) * 256UL + SERVO_FREQ / 2) / SERVO_FREQ))
+#define SERVO_ACCELERATION(a) ((uint16_t) (((uint32_t) (a) * 256UL + SERVO_FREQ * SERVO_FREQ / 2) / (SERVO_FREQ * SERVO_FREQ)))
 
 void servo_init(void);
-void servo_set_mode(uint8_t mode, uint16_t pulse);
+
+//
+// setpoints
+//
+//  servo_set(), servo_move() and servo_set_fine() do not mask interrupts and
+//  may be called from the main loop, a task or an interrupt handler, but a
+//  channel takes one writer at a time, a call must not interrupt another call
+//  for the same channel, set a channel from one context or wrap the calls in
+//  an atomic block
+//
+void servo_set(uint8_t channel, uint8_t mode, uint16_t pulse);
+void servo_move(uint8_t channel, uint16_t pulse, uint16_t velocity, uint16_t acceleration);
+void servo_set_fine(uint8_t channel, uint8_t mode, uint32_t pulse);
+
+#define servo_set_mode(mode, pulse) servo_set(0, (mode), (pulse))
 
 #endif // _SERVO_H_
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <string.h>
+#include <avr/interrupt.h>
+
+#include "project.h"
+#include "timer.h"
+#include "console.h"
+
+//
+// console test
+//
+//  built in place of main.c with the host simulator, see README.md, exits
+//  non-zero on a failure
+//
+//    input   - lines received by the USART are returned by fgets() with the
+//              CR mapped to NL and the ERASE and KILL characters applied
+//    echo    - the input is echoed with the ERASE character echoed as
+//              backspace, space, backspace
+//    output  - NL written by printf() is sent as CR NL
+//
+#define TEST_TX_SIZE 256
+
+// cpu cycles of a 10 bit frame
+#define TEST_FRAME_CYCLES (10UL * F_CPU / BAUD)
+
+extern void timer1_init(void);
+
+static char test_tx[TEST_TX_SIZE];
+static uint16_t test_tx_length;
+static uint16_t test_fails;
+static FILE * test_host;
+
+
+static void test_tx_hook(uint8_t c, uint64_t cycles)
+{
+    if (test_tx_length < (TEST_TX_SIZE - 1))
+    {
+        test_tx[test_tx_length++] = c;
+    }
+}
+
+
+//
+// let the transmitter drain and compare what was sent
+//
+static void test_tx_expect(const char * name, const char * expect)
+{
+    uint16_t length;
+
+    // until the line is quiet for a few frame times
+    do
+    {
+        length = test_tx_length;
+        sim_run(4 * TEST_FRAME_CYCLES);
+    }
+    while (!console_tx_idle() || (length != test_tx_length));
+
+    test_tx[test_tx_length] = '\0';
+
+    if (strcmp(test_tx, expect) != 0)
+    {
+        fprintf(test_host, "%s: sent \"%s\"\n", name, test_tx);
+        test_fails++;
+    }
+
+    test_tx_length = 0;
+}
+
+
+static void test_rx_expect(const char * name, const char * expect)
+{
+    char line[32] = "";
+
+    if (!fgets(line, sizeof(line), stdin) || (strcmp(line, expect) != 0))
+    {
+        fprintf(test_host, "%s: received \"%s\"\n", name, line);
+        test_fails++;
+    }
+}
+
+
+int main(void)
+{
+    // report on the host, stdout is the console once attached
+    test_host = stdout;
+
+    sim_stdin = 0;
+    sim_usart_tx_hook = test_tx_hook;
+
+    cli();
+    timer1_init();
+    timebase_init();
+    console_init();
+    sei();
+
+    sim_usart_rx_str("hello\r");
+    test_rx_expect("input", "hello\n");
+    test_tx_expect("echo", "hello\r\n");
+
+    sim_usart_rx_str("wor\bld\r");
+    test_rx_expect("erase", "wold\n");
+    test_tx_expect("erase echo", "wor\b \bld\r\n");
+
+    sim_usart_rx_str("junk\025ok\r");
+    test_rx_expect("kill", "ok\n");
+    test_tx_expect("kill echo", "junk\b \b\b \b\b \b\b \bok\r\n");
+
+    printf("ok %d\n", 42);
+    test_tx_expect("output", "ok 42\r\n");
+
+    fprintf(test_host, "console_test: %u fails\n", test_fails);
+
+    return test_fails ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <avr/interrupt.h>
+
+#include "project.h"
+#include "timer.h"
+#include "irqprof.h"
+
+//
+// compare interrupt latency test
+//
+//  built in place of main.c with the host simulator, IRQPROF and the code
+//  cost model of -fsanitize-coverage=trace-pc, see test/run.sh, and run
+//  against each TIMER_QUEUE, exits non-zero on a failure
+//
+//    far     - timer events seconds out, the timebase sleeps as long as the
+//              compare reaches between interrupts
+//    spread  - timer events spread over a minute, most in an outer wheel slot
+//              of their own
+//
+//  the longest interrupts disabled window, the compare interrupt, must stay
+//  within TEST_ISR_MAX timer counts
+//
+#ifndef TEST_ISR_MAX
+#define TEST_ISR_MAX 32
+#endif
+
+#define TEST_EVENTS 32
+
+extern void timer1_init(void);
+
+static struct timer_event test_event[TEST_EVENTS];
+static uint8_t test_expired;
+static uint16_t test_fails;
+static uint32_t test_seed = 1;
+
+
+static uint16_t test_rand(void)
+{
+    test_seed = test_seed * 1103515245UL + 12345UL;
+
+    return (uint16_t) (test_seed >> 16);
+}
+
+
+static int8_t test_handler(struct timer_event * this_timer_event)
+{
+    test_expired++;
+
+    return 0;
+}
+
+
+static void test_run(const char * name, uint8_t n, tbtick_t base, tbtick_t spread)
+{
+    struct irqprof_stats stats;
+    uint8_t i;
+
+    test_expired = 0;
+
+    cli();
+
+    for (i = 0; i < n; i++)
+    {
+        init_timer_event(&test_event[i], base + (tbtick_t) (((uint32_t) test_rand() * spread) >> 16), test_handler);
+        schedule_timer_event(&test_event[i], NULL);
+    }
+
+    irqprof_clear();
+
+    sei();
+
+    sim_run((uint64_t) (base + spread + TBTICKS_FROM_MS(10)) * TBTIMER_PRESCALER);
+
+    irqprof_get_stats(&stats);
+
+    if (test_expired != n)
+    {
+        printf("%s: %u of %u timer events expired\n", name, test_expired, n);
+        test_fails++;
+    }
+
+    if (stats.max > TEST_ISR_MAX)
+    {
+        printf("%s: interrupts disabled for %u counts\n", name, stats.max);
+        test_fails++;
+    }
+}
+
+
+int main(void)
+{
+    cli();
+    timer1_init();
+    timebase_init();
+    sei();
+
+    test_run("far", 1, TBTICKS_FROM_S(4), 0);
+    test_run("far", 4, TBTICKS_FROM_S(30), TBTICKS_FROM_S(10));
+    test_run("spread", TEST_EVENTS, TBTICKS_FROM_MS(100), TBTICKS_FROM_S(60));
+
+    printf("latency_test: queue %d, %u fails\n", TIMER_QUEUE, test_fails);
+
+    return test_fails ? 1 : 0;
+}
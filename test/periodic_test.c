@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <avr/interrupt.h>
+
+#include "project.h"
+#include "timer.h"
+
+//
+// periodic timer event test
+//
+//  built in place of main.c with the host simulator, see README.md, and run
+//  against each TIMER_QUEUE, exits non-zero on a failure
+//
+//    catchup - a handler overrunning its period is followed by the missed
+//              periods back to back, in phase
+//    skip    - the missed periods are dropped, in phase
+//    resync  - the period restarts from the end of the overrun
+//    overrun - each period passed when the handler returns is counted, and
+//              the count saturates
+//    rate    - a period with a fraction of a tick keeps every tbtick within
+//              one tick of the ideal over a long run
+//
+#define TEST_PERIOD TBTICKS_FROM_MS(1)
+
+// run of the slow handler, and how long it takes
+#define TEST_STALL_RUN 2
+#define TEST_STALL (TEST_PERIOD * 7 / 2)
+
+#define TEST_RUNS 10
+
+#ifndef TEST_LATE_MAX
+// ticks from the end of an overrun to the resync
+#define TEST_LATE_MAX 4
+#endif
+
+extern void timer1_init(void);
+
+static struct periodic_timer_event test_periodic;
+static tbtick_t test_start;
+static tbtick_t test_tbtick[TEST_RUNS];
+static tbtick_t test_resume;
+static uint32_t test_runs;
+static uint32_t test_periods;
+static tbtick_st test_dev_max;
+static uint16_t test_fails;
+
+
+#define test_fail(...)                                                         \
+    do {                                                                       \
+        if (test_fails < 8) printf(__VA_ARGS__);                               \
+        if (test_fails < UINT16_MAX) test_fails++;                             \
+    } while (0)
+
+
+//
+// record the tbtick of each run, the slow run holds the interrupt for
+// TEST_STALL ticks
+//
+static int8_t test_handler(struct periodic_timer_event * this_periodic_timer_event)
+{
+    test_tbtick[test_runs] = this_periodic_timer_event->timer_event.tbtick - test_start;
+
+    if (test_runs == TEST_STALL_RUN)
+    {
+        sim_run((uint64_t) TEST_STALL * TBTIMER_PRESCALER);
+        test_resume = timebase_now() - test_start;
+    }
+
+    return ++test_runs < TEST_RUNS;
+}
+
+
+static void test_policy(const char * name, uint8_t policy, const tbtick_t * expect, uint16_t overruns)
+{
+    uint8_t i;
+
+    init_periodic_timer_event(&test_periodic, TEST_PERIOD, TEST_PERIOD, policy, test_handler);
+
+    if (overruns == UINT16_MAX)
+    {
+        // one overrun short of saturating
+        test_periodic.overruns = UINT16_MAX - 1;
+    }
+
+    test_runs = 0;
+
+    cli();
+    schedule_periodic_timer_event(&test_periodic, NULL);
+    test_start = test_periodic.timer_event.tbtick;
+    sei();
+
+    sim_run((uint64_t) (TEST_RUNS + 8) * TEST_PERIOD * TBTIMER_PRESCALER);
+
+    if (test_runs != TEST_RUNS)
+    {
+        test_fail("%s: ran %lu times, not %u\n", name, (unsigned long) test_runs, TEST_RUNS);
+        cancel_periodic_timer_event(&test_periodic);
+        return;
+    }
+
+    for (i = 0; i < TEST_RUNS; i++)
+    {
+        // resync restarts from the end of the overrun
+        tbtick_t tbtick = expect[i] + ((policy == TIMER_PERIODIC_RESYNC) && (i > TEST_STALL_RUN) ? test_resume : 0);
+
+        if ((tbtick_st) (test_tbtick[i] - tbtick) < 0 ||
+            (tbtick_st) (test_tbtick[i] - tbtick) > ((policy == TIMER_PERIODIC_RESYNC) ? TEST_LATE_MAX : 0))
+        {
+            test_fail("%s: run %u at tbtick %ld, not %ld\n", name, i, (long) test_tbtick[i], (long) tbtick);
+        }
+    }
+
+    if (test_periodic.overruns != overruns)
+    {
+        test_fail("%s: %u overruns, not %u\n", name, test_periodic.overruns, overruns);
+    }
+}
+
+
+//
+// tbtick of each run in periods from the first, the slow run returns half a
+// period before the fourth period after it
+//
+static const tbtick_t test_catchup[TEST_RUNS] = {
+    0, 1 * TEST_PERIOD, 2 * TEST_PERIOD, 3 * TEST_PERIOD, 4 * TEST_PERIOD,
+    5 * TEST_PERIOD, 6 * TEST_PERIOD, 7 * TEST_PERIOD, 8 * TEST_PERIOD,
+    9 * TEST_PERIOD,
+};
+
+static const tbtick_t test_skip[TEST_RUNS] = {
+    0, 1 * TEST_PERIOD, 2 * TEST_PERIOD, 6 * TEST_PERIOD, 7 * TEST_PERIOD,
+    8 * TEST_PERIOD, 9 * TEST_PERIOD, 10 * TEST_PERIOD, 11 * TEST_PERIOD,
+    12 * TEST_PERIOD,
+};
+
+// after the slow run, from its end
+static const tbtick_t test_resync[TEST_RUNS] = {
+    0, 1 * TEST_PERIOD, 2 * TEST_PERIOD, 1 * TEST_PERIOD, 2 * TEST_PERIOD,
+    3 * TEST_PERIOD, 4 * TEST_PERIOD, 5 * TEST_PERIOD, 6 * TEST_PERIOD,
+    7 * TEST_PERIOD,
+};
+
+
+//
+// deviation of each tbtick from the ideal of a period of num / den ticks
+//
+static uint64_t test_num;
+static uint64_t test_den;
+
+static int8_t test_rate_handler(struct periodic_timer_event * this_periodic_timer_event)
+{
+    tbtick_t ideal = (tbtick_t) ((test_runs * test_num) / test_den);
+    tbtick_st dev = this_periodic_timer_event->timer_event.tbtick - test_start - ideal;
+
+    if (dev < 0)
+    {
+        dev = -dev;
+    }
+
+    if (dev > test_dev_max)
+    {
+        test_dev_max = dev;
+    }
+
+    return ++test_runs < test_periods;
+}
+
+
+static void test_rate(const char * name, uint32_t num, uint32_t den, tbtick_t period, uint16_t period_frac, uint32_t periods)
+{
+    // ticks per period, F_TBTIMER * den / num
+    test_num = (uint64_t) F_CPU * den;
+    test_den = (uint64_t) TBTIMER_PRESCALER * num;
+
+    init_periodic_timer_event(&test_periodic, period, period, TIMER_PERIODIC_CATCHUP, test_rate_handler);
+    set_periodic_timer_frac(&test_periodic, period_frac);
+
+    test_runs = 0;
+    test_periods = periods;
+    test_dev_max = 0;
+
+    cli();
+    schedule_periodic_timer_event(&test_periodic, NULL);
+    test_start = test_periodic.timer_event.tbtick;
+    sei();
+
+    sim_run(((uint64_t) periods * test_num / test_den + 2 * period) * TBTIMER_PRESCALER);
+
+    if (test_runs != periods)
+    {
+        test_fail("%s: ran %lu times, not %lu\n", name, (unsigned long) test_runs, (unsigned long) periods);
+        cancel_periodic_timer_event(&test_periodic);
+    }
+
+    if (test_dev_max > 1)
+    {
+        test_fail("%s: tbtick %ld ticks from the ideal\n", name, (long) test_dev_max);
+    }
+}
+
+
+int main(void)
+{
+    cli();
+    timer1_init();
+    timebase_init();
+    sei();
+
+    test_policy("catchup", TIMER_PERIODIC_CATCHUP, test_catchup, 3);
+    test_policy("skip", TIMER_PERIODIC_SKIP, test_skip, 1);
+    test_policy("resync", TIMER_PERIODIC_RESYNC, test_resync, 1);
+    test_policy("overrun", TIMER_PERIODIC_CATCHUP, test_catchup, UINT16_MAX);
+
+    test_rate("3131 Hz", 3131, 1, TBPERIOD_FROM_RATE(3131, 1), TBPERIOD_FRAC_FROM_RATE(3131, 1), 120000);
+    test_rate("6000/7 Hz", 6000, 7, TBPERIOD_FROM_RATE(6000, 7), TBPERIOD_FRAC_FROM_RATE(6000, 7), 20000);
+
+    printf("periodic_test: queue %d, %u fails\n", TIMER_QUEUE, test_fails);
+
+    return test_fails ? 1 : 0;
+}
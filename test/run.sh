@@ -0,0 +1,52 @@
+#!/bin/sh
+#
+# build and run the host tests, exits non-zero if a test fails
+#
+#   sh test/run.sh
+#
+# CC and CFLAGS may be set in the environment
+#
+cd "$(dirname "$0")/.." || exit 1
+
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--Wall -O2 -std=gnu99}
+DEFS="-Ihost -I. -D__AVR_ATmega328P__ -DF_CPU=16000000 -DBAUD=57600 -DRING_BUFFER_ECHO=1"
+TIMER="timer.c timer_heap.c timer_list.c timer_wheel.c timer1.c irqprof.c"
+HOST="host/sim.c host/stdio.c"
+OUT=${TMPDIR:-/tmp}/avr-timebase-test.$$
+
+mkdir -p "$OUT" || exit 1
+trap 'rm -rf "$OUT"' EXIT
+
+fails=0
+
+run()
+{
+    name=$1
+    shift
+    if $CC $CFLAGS $DEFS -o "$OUT/$name" "$@" && "$OUT/$name"
+    then
+        :
+    else
+        echo "$name: FAILED"
+        fails=$((fails + 1))
+    fi
+}
+
+# the simulator built without the code cost model
+$CC $CFLAGS $DEFS -c -o "$OUT/sim.o" host/sim.c || exit 1
+$CC $CFLAGS $DEFS -c -o "$OUT/stdio.o" host/stdio.c || exit 1
+
+for queue in 0 1 2
+do
+    run timer_test_$queue -DTIMER_QUEUE=$queue test/timer_test.c $TIMER $HOST
+    run periodic_test_$queue -DTIMER_QUEUE=$queue test/periodic_test.c $TIMER $HOST
+    run latency_test_$queue -DTIMER_QUEUE=$queue -DIRQPROF=1 -fsanitize-coverage=trace-pc test/latency_test.c $TIMER "$OUT/sim.o" "$OUT/stdio.o"
+done
+
+# a heap deeper than 128, child indexes past 255
+run timer_test_heap -DTIMER_QUEUE=2 -DTEST_EVENTS=200 -DTIMER_HEAP_SIZE=255 test/timer_test.c $TIMER $HOST
+
+run console_test test/console_test.c console.c ring_buffer.c sched.c $TIMER $HOST
+
+[ $fails -eq 0 ]
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <avr/interrupt.h>
+
+#include "project.h"
+#include "timer.h"
+
+//
+// timer queue test
+//
+//  built in place of main.c with the host simulator, see README.md, and run
+//  against each TIMER_QUEUE, exits non-zero on a failure
+//
+//    expiry  - timer events scheduled at random, some already due, are each
+//              dispatched once, after their tbtick and within TEST_LATE_MAX
+//              ticks of it
+//    cancel  - a cancelled or rescheduled timer event is not dispatched at
+//              its old tbtick
+//    order   - timer events are dispatched in tbtick order
+//    fill    - every timer event live at once is dispatched in tbtick order
+//    period  - a periodic timer event keeps its rate
+//    delay   - timer_delay() does not return early
+//
+#ifndef TEST_EVENTS
+#define TEST_EVENTS 48
+#endif
+
+#ifndef TEST_ROUNDS
+#define TEST_ROUNDS 4000
+#endif
+
+#ifndef TEST_LATE_MAX
+// ticks a timer event may be dispatched after its tbtick
+#define TEST_LATE_MAX 4
+#endif
+
+extern void timer1_init(void);
+
+static struct timer_event test_event[TEST_EVENTS];
+static uint8_t test_armed[TEST_EVENTS];
+static tbtick_t test_due[TEST_EVENTS];
+static tbtick_t test_last;
+static uint8_t test_last_valid;
+static uint16_t test_fails;
+static uint32_t test_seed = 1;
+
+
+static uint16_t test_rand(void)
+{
+    test_seed = test_seed * 1103515245UL + 12345UL;
+
+    return (uint16_t) (test_seed >> 16);
+}
+
+
+#define test_fail(...)                                                         \
+    do {                                                                       \
+        if (test_fails < 8) printf(__VA_ARGS__);                               \
+        if (test_fails < UINT16_MAX) test_fails++;                             \
+    } while (0)
+
+
+static int8_t test_handler(struct timer_event * this_timer_event)
+{
+    uint8_t i = this_timer_event - test_event;
+    tbtick_st late = timebase_now() - test_due[i];
+
+    if (!test_armed[i])
+    {
+        test_fail("event %u dispatched when not scheduled\n", i);
+    }
+
+    if ((late <= 0) || (late > TEST_LATE_MAX))
+    {
+        test_fail("event %u dispatched %ld ticks after its tbtick\n", i, (long) late);
+    }
+
+    if (test_last_valid && ((tbtick_st) (this_timer_event->tbtick - test_last) < 0))
+    {
+        test_fail("event %u dispatched out of order\n", i);
+    }
+
+    test_last = this_timer_event->tbtick;
+    test_last_valid = 1;
+    test_armed[i] = 0;
+
+    return 0;
+}
+
+
+static void test_queue(void)
+{
+    uint16_t round;
+    uint8_t i;
+
+    for (round = 0; round < TEST_ROUNDS; round++)
+    {
+        i = test_rand() % TEST_EVENTS;
+
+        cli();
+
+        switch (test_rand() % 4)
+        {
+        case 0:
+            // cancel
+            cancel_timer_event(&test_event[i]);
+            test_armed[i] = 0;
+            break;
+
+        case 1:
+            // already due or imminent
+            cancel_timer_event(&test_event[i]);
+            init_timer_event(&test_event[i], (tbtick_t) (test_rand() % 8) - 4, test_handler);
+            schedule_timer_event(&test_event[i], NULL);
+            test_armed[i] = 1;
+            break;
+
+        default:
+            // move, scheduled or not
+            reschedule_timer_event(&test_event[i], 1 + test_rand() % 2000, NULL);
+            test_armed[i] = 1;
+            break;
+        }
+
+        // a timer event scheduled in the past is run at once
+        test_due[i] = test_event[i].tbtick;
+        if ((tbtick_st) (test_due[i] - timebase_now()) < 0)
+        {
+            test_due[i] = timebase_now() - 1;
+        }
+
+        // a timer event dispatched out of order was due before one already run
+        test_last_valid = 0;
+
+        sei();
+
+        sim_run((uint64_t) (test_rand() % 64) * TBTIMER_PRESCALER);
+    }
+
+    sim_run((uint64_t) 4000 * TBTIMER_PRESCALER);
+
+    for (i = 0; i < TEST_EVENTS; i++)
+    {
+        if (test_armed[i] || !timer_is_expired(&test_event[i]))
+        {
+            test_fail("event %u never dispatched\n", i);
+        }
+    }
+}
+
+
+static void test_fill(void)
+{
+    uint8_t i;
+
+    cli();
+
+    for (i = 0; i < TEST_EVENTS; i++)
+    {
+        reschedule_timer_event(&test_event[i], 1 + test_rand() % (TEST_EVENTS * 64), NULL);
+        test_armed[i] = 1;
+        test_due[i] = test_event[i].tbtick;
+    }
+
+    test_last_valid = 0;
+
+    sei();
+
+    sim_run((uint64_t) (TEST_EVENTS * 64 + 100) * TBTIMER_PRESCALER);
+
+    for (i = 0; i < TEST_EVENTS; i++)
+    {
+        if (test_armed[i])
+        {
+            test_fail("event %u never dispatched\n", i);
+        }
+    }
+}
+
+
+static uint16_t test_periods;
+
+static int8_t test_periodic_handler(struct periodic_timer_event * this_periodic_timer_event)
+{
+    test_periods++;
+
+    return 1;
+}
+
+
+static void test_period(void)
+{
+    static struct periodic_timer_event test_periodic;
+    tbtick_t period = TBTICKS_FROM_MS(1);
+
+    init_periodic_timer_event(&test_periodic, period, period, TIMER_PERIODIC_CATCHUP, test_periodic_handler);
+
+    test_periods = 0;
+    schedule_periodic_timer_event(&test_periodic, NULL);
+
+    // 100 periods and half of one more
+    sim_run(((uint64_t) period * 201 / 2) * TBTIMER_PRESCALER);
+
+    cancel_periodic_timer_event(&test_periodic);
+
+    if (test_periods != 100)
+    {
+        test_fail("periodic timer event ran %u times, not 100\n", test_periods);
+    }
+}
+
+
+static void test_delay(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < 16; i++)
+    {
+        tbtick_st ticks = test_rand() % 500;
+        tbtick_t start = timebase_now();
+        tbtick_st elapsed;
+
+        timer_delay(ticks);
+
+        elapsed = timebase_now() - start;
+
+        if ((elapsed < ticks) || (elapsed > ticks + TEST_LATE_MAX))
+        {
+            test_fail("timer_delay(%ld) took %ld ticks\n", (long) ticks, (long) elapsed);
+        }
+    }
+}
+
+
+int main(void)
+{
+    uint8_t i;
+
+    cli();
+    timer1_init();
+    timebase_init();
+    sei();
+
+    for (i = 0; i < TEST_EVENTS; i++)
+    {
+        init_timer_event(&test_event[i], 0, test_handler);
+    }
+
+    test_queue();
+    test_fill();
+    test_period();
+    test_delay();
+
+    printf("timer_test: queue %d, %u fails\n", TIMER_QUEUE, test_fails);
+
+    return test_fails ? 1 : 0;
+}
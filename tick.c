@@ -5,23 +5,61 @@
 #include "timer.h"
 
 
+#if TIMER_OUTPUT
+//
+// the speaker is on the timebase compare output pin, the compare unit makes
+// each edge at its tick and the handler only arms the next one
+//
 TIMER_EVENT(tick_timer_event, tick_timer_handler);
-TIMER_EVENT(tick_off_event, tick_off_handler);
 
 
 int8_t tick_timer_handler(struct timer_event * this_timer_event)
+{
+    if (this_timer_event->flags & TIMER_FLAG_OUTPUT_CLEAR)
+    {
+        // output went low, ON, output high, OFF, in 1 ms
+        this_timer_event->tbtick += TBTICKS_FROM_MS(1);
+    }
+    else
+    {
+        // output went high, OFF, output low, ON, at the next second
+        this_timer_event->tbtick += TBTICKS_FROM_MS(1000) - TBTICKS_FROM_MS(1);
+    }
+
+    this_timer_event->flags ^= TIMER_FLAG_OUTPUT;
+
+    // reschedule this timer
+    return 1;
+}
+
+
+void tick_init(void)
+{
+    // initialize speaker output pin, output high, OFF
+    timer_output_init(1);
+
+    // start tick timer
+    tick_timer_event.tbtick = TBTICKS_FROM_MS(1000);
+    tick_timer_event.flags = TIMER_FLAG_OUTPUT_CLEAR;
+    schedule_timer_event(&tick_timer_event, NULL);
+}
+
+#else // TIMER_OUTPUT
+
+static struct periodic_timer_event tick_timer_event;
+TIMER_EVENT(tick_off_event, tick_off_handler);
+
+
+int8_t tick_timer_handler(struct periodic_timer_event * this_periodic_timer_event)
 {
     // output low, ON
     PORTD &= ~_BV(PORTD4);
 
     // schedule the output off timer for 1 ms
     tick_off_event.tbtick = TBTICKS_FROM_MS(1);
-    schedule_timer_event(&tick_off_event, this_timer_event);
+    schedule_timer_event(&tick_off_event, &this_periodic_timer_event->timer_event);
 
-    // advance this timer one second
-    this_timer_event->tbtick += TBTICKS_FROM_MS(1000);
-
-    // reschedule this timer
+    // keep running, one tick per second
     return 1;
 }
 
@@ -42,7 +80,11 @@ void tick_init(void)
     PORTD |= _BV(PORTD4);
     DDRD |= _BV(DDD4);
 
-    // start tick timer
-    tick_timer_event.tbtick = TBTICKS_FROM_MS(1000);
-    schedule_timer_event(&tick_timer_event, NULL);
+    // start tick timer, a late tick never bursts
+    init_periodic_timer_event(&tick_timer_event, TBTICKS_FROM_MS(1000),
+                              TBTICKS_FROM_MS(1000), TIMER_PERIODIC_SKIP,
+                              tick_timer_handler);
+    schedule_periodic_timer_event(&tick_timer_event, NULL);
 }
+
+#endif // TIMER_OUTPUT
@@ -1,59 +1,370 @@
 #include <stdio.h>
+#include <string.h>
 #include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include <util/atomic.h>
 
 #include "project.h"
 #include "timer.h"
+#include "timer_queue.h"
+#include "irqprof.h"
 
 //
 // system timebase
 //
 static tbtick_t system_tick;
-static struct timer_event * timer_event_list;
+
+//
+// timebase generation, advanced whenever system_tick is updated or an
+// interrupt handler accesses a 16-bit register of the timebase timer
+//
+volatile uint8_t timebase_gen;
+
+//
+// tick of the programmed compare interrupt, and set while the compare
+// interrupt handler dispatches
+//
+static tbtick_t timer_compare;
+static uint8_t timer_dispatching;
+
+#if TIMER_SLACK
+static struct timer_stats timer_stats;
+#endif
+
+#if TBSIZE < 64 && TIMER_EPOCH
+//
+// timebase epoch, the 64-bit timebase at the last epoch event, the epoch
+// event extends it every quarter turn of system_tick
+//
+#define TIMEBASE_EPOCH_PERIOD (((tbtick_t) 1) << (TBSIZE - 2))
+
+static uint64_t timebase_epoch;
+static struct timer_event timebase_epoch_event;
+#endif
+
+#if TIMER_DEFERRED
+//
+// deferred timer events
+//
+//  expired timer events flagged TIMER_FLAG_DEFERRED are put on a single
+//  producer, single consumer ring by the compare interrupt and their handlers
+//  are run later by timer_run_pending() with interrupts enabled
+//
+//  while on the ring a timer event is flagged TIMER_FLAG_PENDING, cancelling
+//  or scheduling the timer event clears the flag and the handler is skipped
+//
+#ifndef TIMER_PENDING_SIZE
+#define TIMER_PENDING_SIZE 8
+#endif
+
+#if TIMER_PENDING_SIZE & (TIMER_PENDING_SIZE - 1)
+#error "TIMER_PENDING_SIZE must be a power of 2."
+#endif
+
+static struct timer_event * timer_pending[TIMER_PENDING_SIZE];
+static volatile uint8_t timer_pending_put;
+static volatile uint8_t timer_pending_get;
+static uint8_t timer_pending_busy;
+
+
+//
+// put an expired timer event on the pending ring, returns 0 if the ring is
+// full, called with interrupts disabled
+//
+static uint8_t defer_timer_event(struct timer_event * this_timer_event)
+{
+    uint8_t put = timer_pending_put;
+    uint8_t next = (put + 1) & (TIMER_PENDING_SIZE - 1);
+
+    if (next == timer_pending_get)
+    {
+        return 0;
+    }
+
+    timer_pending[put] = this_timer_event;
+    this_timer_event->flags |= TIMER_FLAG_PENDING;
+    timer_pending_put = next;
+
+    return 1;
+}
+#endif // TIMER_DEFERRED
+
+#if TIMER_OUTPUT
+//
+// compare output pin
+//
+//  a timer event flagged TIMER_FLAG_OUTPUT_SET or TIMER_FLAG_OUTPUT_CLEAR
+//  drives the compare output pin of the timebase timer, when it is the next
+//  timer event to expire its compare output mode is selected before the
+//  compare register is written and the compare is programmed at its tbtick
+//  rather than the tick after, the pin changes in hardware as the timebase
+//  reaches tbtick, the interrupt there finds the timer event not yet expired
+//  and the next tick dispatches it as usual, the handler only arms the next
+//  edge
+//
+//  set and clear are idempotent, between edges the compare output mode holds
+//  the current level so the compare matches of other timer events leave the
+//  pin alone, and the edge is forced when the timer event is dispatched in
+//  case the compare match was missed, a timer event scheduled too close to
+//  the timebase or sharing its tick with another timer event, an edge due in
+//  the tick the interrupt runs, as on the tick after another edge, is forced
+//  there, slack is not supported
+//
+#if defined (__AVR_ATmega328P__) || defined (__AVR_ATmega328__)
+#define TBOC_DDR_0A DDRD
+#define TBOC_DD_0A DDD6
+#define TBOC_DDR_0B DDRD
+#define TBOC_DD_0B DDD5
+#define TBOC_DDR_1A DDRB
+#define TBOC_DD_1A DDB1
+#define TBOC_DDR_1B DDRB
+#define TBOC_DD_1B DDB2
+#define TBOC_DDR_2A DDRB
+#define TBOC_DD_2A DDB3
+#define TBOC_DDR_2B DDRD
+#define TBOC_DD_2B DDD3
+#else
+#error "Timebase compare output pin unknown for this device."
+#endif
+
+#define _TBOCDDR(a,b) _TBJOIN3(TBOC_DDR_,a,b)
+#define _TBOCDD(a,b) _TBJOIN3(TBOC_DD_,a,b)
+
+#define TBOCDDR _TBOCDDR(TBTIMER,TBTIMER_COMP)
+#define TBOCDD _TBOCDD(TBTIMER,TBTIMER_COMP)
+
+// compare output modes, set and clear on compare match
+#define TBCOM_MASK (_BV(TBCOM1) | _BV(TBCOM0))
+#define TBCOM_SET (_BV(TBCOM1) | _BV(TBCOM0))
+#define TBCOM_CLEAR (_BV(TBCOM1))
+
+#define timer_output_com(a) (((a) & TIMER_FLAG_OUTPUT_SET) ? (TBCOM_SET) : (TBCOM_CLEAR))
+
+// compare output mode holding the current level of the pin
+static uint8_t timer_output_level;
+
+
+static inline void set_timer_output_com(uint8_t com)
+{
+    TBTCCRA = (TBTCCRA & ~TBCOM_MASK) | com;
+}
+
+
+//
+// drive the pin to the level of an expired timer event
+//
+static void timer_output_force(struct timer_event * this_timer_event)
+{
+    timer_output_level = timer_output_com(this_timer_event->flags);
+    set_timer_output_com(timer_output_level);
+
+    // force compare match, the pin takes the compare output mode level
+    TBTCCRF |= _BV(TBFOC);
+}
+
+
+//
+// select the compare output mode for the compare match at tbtick, the timer
+// event is the next to expire or NULL
+//
+//  a compare at or after the tbtick of an output timer event takes its level,
+//  its edge may already have been made in hardware
+//
+static void timer_output_arm(struct timer_event * this_timer_event, tbtick_t tbtick)
+{
+    uint8_t com = timer_output_level;
+
+    if (this_timer_event &&
+        (this_timer_event->flags & TIMER_FLAG_OUTPUT) &&
+        ((tbtick_st) (tbtick - this_timer_event->tbtick) >= 0))
+    {
+        com = timer_output_com(this_timer_event->flags);
+    }
+
+    set_timer_output_com(com);
+}
+
+
+//
+// connect the compare output pin at level, its edges are then made by timer
+// events flagged TIMER_FLAG_OUTPUT_SET or TIMER_FLAG_OUTPUT_CLEAR
+//
+void timer_output_init(uint8_t level)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        timer_output_level = (level) ? (TBCOM_SET) : (TBCOM_CLEAR);
+        set_timer_output_com(timer_output_level);
+
+        // force compare match, set the initial level
+        TBTCCRF |= _BV(TBFOC);
+
+        // output enable
+        TBOCDDR |= _BV(TBOCDD);
+    }
+}
+#endif // TIMER_OUTPUT
+
+#if TIMER_HISTOGRAM
+//
+// dispatch latency histograms
+//
+static struct timer_latency timer_latency;
+
+
+//
+// count a value in a histogram, called with interrupts disabled
+//
+static void timer_histogram_add(struct timer_histogram * histogram, tbtick_t value)
+{
+    uint8_t bucket;
+    tbtick_t range;
+
+    // log2 bucket, the last bucket holds everything larger
+    for ( bucket = 0, range = value;
+          range && (bucket < (TIMER_HISTOGRAM_BUCKETS - 1));
+          bucket++, range >>= 1);
+
+    if (histogram->bucket[bucket] != UINT16_MAX)
+    {
+        histogram->bucket[bucket]++;
+    }
+
+    if ((histogram->count == 0) || (value < histogram->min))
+    {
+        histogram->min = value;
+    }
+
+    if ((histogram->count == 0) || (value > histogram->max))
+    {
+        histogram->max = value;
+    }
+
+    histogram->count++;
+}
+
+
+//
+// run the handler of an expired timer event and record its run time
+//
+static int8_t timer_run_handler(struct timer_event * this_timer_event)
+{
+    tbtimer_t start;
+    tbtimer_t ticks;
+    int8_t rearm;
+
+    start = timebase_get();
+    rearm = this_timer_event->handler(this_timer_event);
+    ticks = timebase_get() - start;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if ((timer_latency.run_time.count == 0) || (ticks >= timer_latency.run_time.max))
+        {
+            timer_latency.slowest = this_timer_event->handler;
+        }
+
+        timer_histogram_add(&timer_latency.run_time, ticks);
+    }
+
+    return rearm;
+}
+#else
+#define timer_run_handler(a) ((a)->handler(a))
+#endif // TIMER_HISTOGRAM
 
 
 static inline tbtick_t timebase_update(void)
 {
+    timebase_touch();
+
     return (system_tick += (tbtimer_t) (TBTCNT - system_tick));
 }
 
 
-static void link_timer_event(struct timer_event * this_timer_event)
+//
+// dispatch an expired timer event
+//
+static inline void timer_dispatch(struct timer_event * this_timer_event)
 {
-    struct timer_event ** tthis_timer_event;
+#if TIMER_SLACK
+    timer_stats.expired++;
+
+    if ((tbtick_st) (timer_event_key(this_timer_event) - system_tick) >= 0)
+    {
+        // expired early within its slack
+        timer_stats.coalesced++;
+    }
+#endif
 
-    for ( tthis_timer_event  = &timer_event_list;
-         *tthis_timer_event != NULL;
-          tthis_timer_event  = &((*tthis_timer_event)->next))
+#if TIMER_OUTPUT
+    if (this_timer_event->flags & TIMER_FLAG_OUTPUT)
     {
-        if ((tbtick_st) (this_timer_event->tbtick - (*tthis_timer_event)->tbtick) < 0)
+        // make sure the edge was made
+        timer_output_force(this_timer_event);
+    }
+#endif
+
+    // handle expired timer event
+    if (this_timer_event->handler)
+    {
+#if TIMER_DEFERRED
+        if ((this_timer_event->flags & TIMER_FLAG_DEFERRED) &&
+            defer_timer_event(this_timer_event))
         {
-            break;
+            // handler deferred, run here only if the ring is full, its
+            // lateness is counted when it runs
+            return;
+        }
+#endif
+#if TIMER_HISTOGRAM
+        timer_histogram_add(&timer_latency.lateness, system_tick - this_timer_event->tbtick);
+#endif
+        if (timer_run_handler(this_timer_event))
+        {
+            link_timer_event(this_timer_event);
         }
     }
-
-    this_timer_event->next = *tthis_timer_event;
-    *tthis_timer_event = this_timer_event;
 }
 
 
-static void unlink_timer_event(struct timer_event * this_timer_event)
+#if TIMER_PRIORITY
+//
+// expire the timer events due at tbtick into a batch, highest priority first
+// and in queue order within a priority, returns the batch size
+//
+//  a batched timer event is flagged TIMER_FLAG_DUE, scheduling or cancelling
+//  it clears the flag and it is dropped from the batch
+//
+static uint8_t expire_timer_batch(struct timer_event ** batch, tbtick_t tbtick, tbtick_st * delta)
 {
-    struct timer_event ** tthis_timer_event;
+    struct timer_event * this_timer_event;
+    uint8_t n;
+    uint8_t i;
 
-    for ( tthis_timer_event  = &timer_event_list;
-         *tthis_timer_event != NULL;
-          tthis_timer_event  = &((*tthis_timer_event)->next))
+    for (n = 0; n < TIMER_BATCH_SIZE; n++)
     {
-        if (*tthis_timer_event == this_timer_event)
+        this_timer_event = expire_timer_event(tbtick, delta);
+
+        if (this_timer_event == NULL)
         {
-            *tthis_timer_event = this_timer_event->next;
             break;
         }
+
+        this_timer_event->flags |= TIMER_FLAG_DUE;
+
+        // insert after timer events of the same or higher priority
+        for (i = n; (i > 0) && (batch[i - 1]->priority < this_timer_event->priority); i--)
+        {
+            batch[i] = batch[i - 1];
+        }
+
+        batch[i] = this_timer_event;
     }
 
-    this_timer_event->next = this_timer_event;
+    return n;
 }
+#endif // TIMER_PRIORITY
 
 
 //
@@ -61,64 +372,295 @@ static void unlink_timer_event(struct timer_event * this_timer_event)
 //
 void tbtimer_handler(void)
 {
+    timer_dispatching = 1;
+
+#if TIMER_PRIORITY
+#if TIMER_BUDGET
+    tbtick_t start = timebase_update();
+#endif
+    uint8_t over = 0;
+#endif
+
     for (;;)
     {
         tbtick_st delta;
         tbtimer_t ocr;
+        uint8_t more = 0;
 
-        timebase_update();
+#if TIMER_PRIORITY
+        struct timer_event * batch[TIMER_BATCH_SIZE];
+        uint8_t n;
+        uint8_t i;
 
-        if (timer_event_list == NULL)
+        if (over)
         {
-            // no pending timer events
-            delta = TBTIMER_MAX_DELAY;
+            // budget spent, interrupt again next tick for the rest
+            timebase_update();
+            delta = 0;
         }
-        else
+        else if ((n = expire_timer_batch(batch, timebase_update(), &delta)))
         {
-            // process timer event
-            delta = timer_event_list->tbtick - system_tick;
-
-            if (delta < 0)
+            for (i = 0; i < n; i++)
             {
-                // handle expired timer event
-                struct timer_event * this_timer_event;
+                struct timer_event * this_timer_event = batch[i];
 
-                this_timer_event = timer_event_list;
-                timer_event_list = this_timer_event->next;
-                this_timer_event->next = this_timer_event;
+                if (!(this_timer_event->flags & TIMER_FLAG_DUE))
+                {
+                    // scheduled or cancelled by an earlier handler
+                    continue;
+                }
 
-                if (this_timer_event->handler)
+                this_timer_event->flags &= ~TIMER_FLAG_DUE;
+
+#if TIMER_BUDGET
+                if ((over ||
+                     ((tbtick_t) (timebase_update() - start) >= TIMER_BUDGET)) &&
+                    (this_timer_event->priority < TIMER_PRIORITY_CRITICAL))
                 {
-                    if (this_timer_event->handler(this_timer_event))
-                    {
-                        link_timer_event(this_timer_event);
-                    }
+                    // leave for the next pass
+                    link_timer_event(this_timer_event);
+                    over = 1;
+                    continue;
                 }
+#endif
 
-                continue;
+                timer_dispatch(this_timer_event);
             }
 
-            if (delta > TBTIMER_MAX_DELAY)
+            continue;
+        }
+#else
+        struct timer_event * this_timer_event;
+
+        this_timer_event = expire_timer_event(timebase_update(), &delta);
+
+        if (this_timer_event)
+        {
+            timer_dispatch(this_timer_event);
+
+            continue;
+        }
+#endif
+
+        if (delta < 0)
+        {
+            // queue work left, interrupt again next tick for the rest
+            timebase_update();
+            delta = 0;
+            more = 1;
+        }
+
+        if (delta > TBTIMER_MAX_DELAY)
+        {
+            // limit delta to maximum supported by timer
+            delta = TBTIMER_MAX_DELAY;
+        }
+
+        timer_compare = system_tick + delta + 1;
+
+#if TIMER_OUTPUT
+        {
+            struct timer_event * next_timer_event = peek_timer_event();
+
+            if (next_timer_event &&
+                (next_timer_event->flags & TIMER_FLAG_OUTPUT) &&
+                (next_timer_event->tbtick == (tbtick_t) (system_tick + delta)))
             {
-                // limit delta to maximum supported by timer
-                delta = TBTIMER_MAX_DELAY;
+                if (delta)
+                {
+                    // output edge at expiry
+                    timer_compare--;
+                }
+                else
+                {
+                    // expiry is this tick, too late for the compare
+                    timer_output_force(next_timer_event);
+                }
             }
+
+            timer_output_arm(next_timer_event, timer_compare);
         }
+#endif
+
+        TBOCR = ocr = (tbtimer_t) timer_compare;
 
-        TBOCR = ocr = (tbtimer_t) system_tick + delta + 1;
+        if (more)
+        {
+            // return to let other interrupts in, with the compare ahead of the
+            // timer even if the tick has passed
+            tbtimer_t margin = 1;
+
+            while ((tbtimer_st) (TBTCNT - ocr) >= 0)
+            {
+                margin <<= 1;
+                TBOCR = ocr = TBTCNT + margin;
+            }
+
+            timer_compare += (tbtimer_t) (ocr - (tbtimer_t) timer_compare);
+            break;
+        }
 
         if ((tbtimer_st) (TBTCNT - ocr) < 0)
         {
             break;
         }
     }
+
+    timer_dispatching = 0;
+}
+
+
+//
+// program the compare interrupt for a timer event just linked, called with
+// interrupts disabled
+//
+//  only the compare interrupt dispatches, the compare is moved earlier if the
+//  timer event needs service before it and is otherwise left alone, a compare
+//  left early by a cancelled timer event finds nothing due and is
+//  reprogrammed by the interrupt, while the compare interrupt handler
+//  dispatches it reprograms the compare itself
+//
+static void timer_arm(struct timer_event * this_timer_event)
+{
+    tbtick_t tbtick;
+    tbtimer_t ocr;
+    tbtimer_t margin = 1;
+
+    if (timer_dispatching)
+    {
+        return;
+    }
+
+    // the interrupt is the tick after expiry
+    tbtick = timer_event_key(this_timer_event) + 1;
+
+#if TIMER_OUTPUT
+    if (this_timer_event->flags & TIMER_FLAG_OUTPUT)
+    {
+        // output edge at expiry
+        tbtick--;
+    }
+#endif
+
+    if ((tbtick_st) (tbtick - timer_compare) >= 0)
+    {
+        return;
+    }
+
+    if ((tbtick_st) (tbtick - timebase_update()) <= 0)
+    {
+        // already expired, interrupt next tick
+        tbtick = system_tick + 1;
+    }
+
+#if TIMER_OUTPUT
+    timer_output_arm(this_timer_event, tbtick);
+#endif
+
+    TBOCR = ocr = (tbtimer_t) tbtick;
+
+    while ((tbtimer_st) (TBTCNT - ocr) >= 0)
+    {
+        // passed before it was written, try further ahead
+        margin <<= 1;
+        TBOCR = ocr = TBTCNT + margin;
+    }
+
+    timer_compare = tbtick + (tbtimer_t) (ocr - (tbtimer_t) tbtick);
 }
 
 
 ISR(TBTIMER_COMP_vect)
 {
+#if TIMER_SLACK
+    timer_stats.interrupts++;
+#endif
+
+    irqprof_begin();
     tbtimer_handler();
+    irqprof_end(PSTR("TBTIMER_COMP_vect"));
+
+#if TIMER_DEFERRED && TIMER_PENDING_SOFTIRQ
+    // run deferred handlers with interrupts enabled
+    timer_run_pending();
+#endif
+}
+
+
+#if TIMER_DEFERRED
+//
+// run the handlers of pending deferred timer events
+//
+//  called from the main loop or, with TIMER_PENDING_SOFTIRQ, from the tail of
+//  the compare interrupt, handlers are always run with interrupts enabled and
+//  a call made while handlers are being run returns immediately
+//
+void timer_run_pending(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (timer_pending_busy)
+        {
+            return;
+        }
+
+        timer_pending_busy = 1;
+    }
+
+    for (;;)
+    {
+        struct timer_event * this_timer_event;
+        uint8_t get;
+        uint8_t pending;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            get = timer_pending_get;
+
+            if (get == timer_pending_put)
+            {
+                // ring is empty
+                timer_pending_busy = 0;
+                return;
+            }
+
+            this_timer_event = timer_pending[get];
+            timer_pending_get = (get + 1) & (TIMER_PENDING_SIZE - 1);
+
+            pending = this_timer_event->flags & TIMER_FLAG_PENDING;
+            this_timer_event->flags &= ~TIMER_FLAG_PENDING;
+
+#if TIMER_HISTOGRAM
+            if (pending)
+            {
+                timer_histogram_add(&timer_latency.lateness, timebase_now() - this_timer_event->tbtick);
+            }
+#endif
+        }
+
+        if (!pending)
+        {
+            // cancelled or scheduled since it expired
+            continue;
+        }
+
+        NONATOMIC_BLOCK(NONATOMIC_RESTORESTATE)
+        {
+            pending = timer_run_handler(this_timer_event);
+        }
+
+        if (pending)
+        {
+            IRQPROF_ATOMIC_BLOCK("timer_run_pending")
+            {
+                link_timer_event(this_timer_event);
+
+                timer_arm(this_timer_event);
+            }
+        }
+    }
 }
+#endif // TIMER_DEFERRED
 
 
 tbtimer_t timebase_get(void)
@@ -127,6 +669,8 @@ tbtimer_t timebase_get(void)
 
     ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
+        // for a timebase_now() this may have interrupted
+        timebase_touch();
         tbtcnt = TBTCNT;
     }
 
@@ -134,38 +678,396 @@ tbtimer_t timebase_get(void)
 }
 
 
+//
+// full width timebase without disabling interrupts
+//
+//  system_tick and the timer are read together and the read is retried if an
+//  interrupt has advanced the timebase generation in the meantime, this also
+//  catches a 16-bit timer read torn by an interrupt handler sharing the timer
+//  TEMP register, safe to call from any context
+//
+//  called with interrupts disabled it may be in an interrupt handler, its own
+//  timer read uses TEMP so it advances the generation for a read it may have
+//  interrupted
+//
+tbtick_t timebase_now(void)
+{
+    uint8_t gen;
+    tbtick_t tick;
+    tbtimer_t tbtcnt;
+
+    if (!test_bit(SREG, SREG_I))
+    {
+        timebase_touch();
+    }
+
+    do
+    {
+        gen = timebase_gen;
+        tick = *(volatile tbtick_t *) &system_tick;
+        tbtcnt = TBTCNT;
+    }
+    while (gen != timebase_gen);
+
+    return tick + (tbtimer_t) (tbtcnt - (tbtimer_t) tick);
+}
+
+
+#if TBSIZE < 64 && TIMER_EPOCH
+static int8_t timebase_epoch_handler(struct timer_event * this_timer_event)
+{
+    timebase_epoch += (tbtick_t) (system_tick - (tbtick_t) timebase_epoch);
+
+    this_timer_event->tbtick += TIMEBASE_EPOCH_PERIOD;
+
+    return 1;
+}
+
+
+//
+// 64-bit timebase, timebase_now() extended by the epoch
+//
+uint64_t timebase_now64(void)
+{
+    uint8_t gen;
+    uint64_t epoch;
+    tbtick_t tick;
+    tbtimer_t tbtcnt;
+
+    // as timebase_now()
+    if (!test_bit(SREG, SREG_I))
+    {
+        timebase_touch();
+    }
+
+    do
+    {
+        gen = timebase_gen;
+        epoch = *(volatile uint64_t *) &timebase_epoch;
+        tick = *(volatile tbtick_t *) &system_tick;
+        tbtcnt = TBTCNT;
+    }
+    while (gen != timebase_gen);
+
+    tick += (tbtimer_t) (tbtcnt - (tbtimer_t) tick);
+
+    return epoch + (tbtick_t) (tick - (tbtick_t) epoch);
+}
+#endif
+
+
 void timebase_delay(tbtimer_st counts)
 {
     tbtimer_t terminal;
 
+    if ((counts > TIMER_IDLE_MIN) && test_bit(SREG, SREG_I))
+    {
+        // long enough to sleep through
+        timer_delay(counts);
+
+        return;
+    }
+
     terminal = timebase_get() + counts;
 
     while ((tbtimer_st) (terminal - timebase_get()) >= 0);
 }
 
 
-void schedule_timer_event(struct timer_event * this_timer_event, struct timer_event * ref_timer_event)
+//
+// schedule a timer event tbtick ticks after the reference timer event or now,
+// returns -1 if the queue is full and the timer event is left expired
+//
+int8_t schedule_timer_event(struct timer_event * this_timer_event, struct timer_event * ref_timer_event)
 {
-    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    int8_t rc = 0;
+
+    IRQPROF_ATOMIC_BLOCK("schedule_timer_event")
     {
         this_timer_event->tbtick += (ref_timer_event) ? (ref_timer_event->tbtick) : (timebase_update());
+#if TIMER_DEFERRED || TIMER_PRIORITY
+        this_timer_event->flags &= ~(TIMER_FLAG_PENDING | TIMER_FLAG_DUE);
+#endif
 
         link_timer_event(this_timer_event);
 
-        tbtimer_handler();
+        if (timer_is_expired(this_timer_event))
+        {
+            rc = -1;
+        }
+        else
+        {
+            timer_arm(this_timer_event);
+        }
+    }
+
+    return rc;
+}
+
+
+//
+// move a timer event, scheduled or not, to tbtick ticks after the reference
+// timer event or now, a scheduled timer event keeps its place in the queue
+// until the move is complete, returns -1 if the timer event was not scheduled
+// and the queue is full
+//
+int8_t reschedule_timer_event(struct timer_event * this_timer_event, tbtick_t tbtick, struct timer_event * ref_timer_event)
+{
+    int8_t rc = 0;
+
+    IRQPROF_ATOMIC_BLOCK("reschedule_timer_event")
+    {
+        this_timer_event->tbtick = tbtick + ((ref_timer_event) ? (ref_timer_event->tbtick) : (timebase_update()));
+#if TIMER_DEFERRED || TIMER_PRIORITY
+        this_timer_event->flags &= ~(TIMER_FLAG_PENDING | TIMER_FLAG_DUE);
+#endif
+
+        relink_timer_event(this_timer_event);
+
+        if (timer_is_expired(this_timer_event))
+        {
+            rc = -1;
+        }
+        else
+        {
+            timer_arm(this_timer_event);
+        }
     }
+
+    return rc;
 }
 
 
 void cancel_timer_event(struct timer_event * this_timer_event)
 {
-    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    IRQPROF_ATOMIC_BLOCK("cancel_timer_event")
     {
         unlink_timer_event(this_timer_event);
+#if TIMER_DEFERRED || TIMER_PRIORITY
+        this_timer_event->flags &= ~(TIMER_FLAG_PENDING | TIMER_FLAG_DUE);
+#endif
+    }
+}
+
+
+#if TIMER_SLACK
+void timer_get_stats(struct timer_stats * stats)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *stats = timer_stats;
+    }
+}
+#endif
+
+
+#if TIMER_HISTOGRAM
+void timer_get_latency(struct timer_latency * latency)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *latency = timer_latency;
+    }
+}
+
+
+void timer_clear_latency(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memset(&timer_latency, 0, sizeof(timer_latency));
+    }
+}
+
+
+static void timer_print_histogram(const char * name, struct timer_histogram * histogram)
+{
+    uint8_t bucket;
 
-        tbtimer_handler();
+    printf("%s: count %lu min %lu max %lu\n", name,
+           (unsigned long) histogram->count,
+           (unsigned long) histogram->min,
+           (unsigned long) histogram->max);
+
+    for (bucket = 0; bucket < TIMER_HISTOGRAM_BUCKETS; bucket++)
+    {
+        if (histogram->bucket[bucket] == 0)
+        {
+            continue;
+        }
+
+        if (bucket < (TIMER_HISTOGRAM_BUCKETS - 1))
+        {
+            printf("  <  %6lu : %u\n", 1UL << bucket, histogram->bucket[bucket]);
+        }
+        else
+        {
+            printf("  >= %6lu : %u\n", 1UL << (bucket - 1), histogram->bucket[bucket]);
+        }
+    }
+}
+
+
+//
+// print the dispatch latency histograms on the console, in timebase ticks
+//
+void timer_print_latency(void)
+{
+    struct timer_latency latency;
+
+    timer_get_latency(&latency);
+
+    timer_print_histogram("lateness", &latency.lateness);
+    timer_print_histogram("run time", &latency.run_time);
+
+    // a program memory word address on the target
+    printf("slowest handler 0x%04x\n", (uint16_t) (uintptr_t) latency.slowest);
+}
+#endif // TIMER_HISTOGRAM
+
+
+#if TIMER_LONG
+//
+// point the embedded timer event at the 64-bit tbtick, or as far toward it as
+// the timebase allows
+//
+static void arm_long_timer_event(struct long_timer_event * this_long_timer_event, uint64_t now)
+{
+    if ((int64_t) (this_long_timer_event->tbtick - now) > (int64_t) TIMEBASE_MAX_DELAY)
+    {
+        this_long_timer_event->timer_event.tbtick = (tbtick_t) now + TIMEBASE_MAX_DELAY;
+    }
+    else
+    {
+        this_long_timer_event->timer_event.tbtick = (tbtick_t) this_long_timer_event->tbtick;
+    }
+}
+
+
+static int8_t long_timer_handler(struct timer_event * this_timer_event)
+{
+    struct long_timer_event * this_long_timer_event = (struct long_timer_event *) this_timer_event;
+    uint64_t now = timebase_now64();
+
+    if ((int64_t) (this_long_timer_event->tbtick - now) >= 0)
+    {
+        // not yet expired, re-arm
+        arm_long_timer_event(this_long_timer_event, now);
+
+        return 1;
+    }
+
+    if (this_long_timer_event->handler)
+    {
+        if (this_long_timer_event->handler(this_long_timer_event))
+        {
+            arm_long_timer_event(this_long_timer_event, now);
+
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+void schedule_long_timer_event(struct long_timer_event * this_long_timer_event, struct long_timer_event * ref_long_timer_event)
+{
+    IRQPROF_ATOMIC_BLOCK("schedule_long_timer_event")
+    {
+        uint64_t now = timebase_now64();
+
+        this_long_timer_event->tbtick += (ref_long_timer_event) ? (ref_long_timer_event->tbtick) : (now);
+        this_long_timer_event->timer_event.handler = long_timer_handler;
+#if TIMER_DEFERRED || TIMER_PRIORITY
+        this_long_timer_event->timer_event.flags &= ~(TIMER_FLAG_PENDING | TIMER_FLAG_DUE);
+#endif
+
+        arm_long_timer_event(this_long_timer_event, now);
+
+        link_timer_event(&this_long_timer_event->timer_event);
+
+        timer_arm(&this_long_timer_event->timer_event);
     }
 }
+#endif // TIMER_LONG
+
+
+//
+// advance a periodic timer event by n periods, carrying the summed fraction
+// into tbtick
+//
+static void advance_periodic_timer_event(struct periodic_timer_event * this_periodic_timer_event, tbtick_t n)
+{
+    struct timer_event * this_timer_event = &this_periodic_timer_event->timer_event;
+
+    if (n == 1)
+    {
+        uint32_t phase_frac = (uint32_t) this_periodic_timer_event->phase_frac + this_periodic_timer_event->period_frac;
+
+        this_timer_event->tbtick += this_periodic_timer_event->period + (tbtick_t) (phase_frac >> 16);
+        this_periodic_timer_event->phase_frac = (uint16_t) phase_frac;
+    }
+    else
+    {
+        uint64_t phase_frac = (uint64_t) n * this_periodic_timer_event->period_frac + this_periodic_timer_event->phase_frac;
+
+        this_timer_event->tbtick += n * this_periodic_timer_event->period + (tbtick_t) (phase_frac >> 16);
+        this_periodic_timer_event->phase_frac = (uint16_t) phase_frac;
+    }
+}
+
+
+//
+// run a periodic timer event and re-arm it one period on, the overrun policy
+// applies if that has already passed
+//
+int8_t periodic_timer_handler(struct timer_event * this_timer_event)
+{
+    struct periodic_timer_event * this_periodic_timer_event = (struct periodic_timer_event *) this_timer_event;
+    tbtick_t now;
+    tbtick_t late;
+
+    if (!this_periodic_timer_event->handler(this_periodic_timer_event))
+    {
+        return 0;
+    }
+
+    advance_periodic_timer_event(this_periodic_timer_event, 1);
+
+    now = timebase_now();
+    late = now - this_timer_event->tbtick;
+
+    if ((tbtick_st) late <= 0)
+    {
+        // next period has not yet expired
+        return 1;
+    }
+
+    if (this_periodic_timer_event->overruns != UINT16_MAX)
+    {
+        this_periodic_timer_event->overruns++;
+    }
+
+    switch (this_periodic_timer_event->policy)
+    {
+    case TIMER_PERIODIC_SKIP:
+        // advance by whole periods to the first not yet expired
+        advance_periodic_timer_event(this_periodic_timer_event,
+                                     (late - 1) / this_periodic_timer_event->period + 1);
+        break;
+
+    case TIMER_PERIODIC_RESYNC:
+        this_timer_event->tbtick = now + this_periodic_timer_event->period;
+        break;
+
+    default:
+        // catch up, expire again at once
+        break;
+    }
+
+    return 1;
+}
 
 
 void timer_delay(tbtick_st ticks)
@@ -174,9 +1076,57 @@ void timer_delay(tbtick_st ticks)
 
     init_timer_event(&timer_delay_event, ticks, NULL);
 
-    schedule_timer_event(&timer_delay_event, NULL);
+    if (schedule_timer_event(&timer_delay_event, NULL))
+    {
+        // queue is full, spin on the timebase
+        tbtick_t terminal = timer_delay_event.tbtick;
+
+        while ((tbtick_st) (timebase_now() - terminal) < 0);
+        return;
+    }
 
-    while (!timer_is_expired(&timer_delay_event));
+    for (;;)
+    {
+        irqprof_cli();
+        if (timer_is_expired(&timer_delay_event)) break;
+        timer_idle();
+    }
+
+    irqprof_sei("timer_delay");
+}
+
+
+//
+// tickless idle
+//
+//  sleep until the next interrupt, the compare interrupt is only programmed
+//  for the next timer event so the core stays asleep until it is due or
+//  another interrupt needs service
+//
+//  called with interrupts disabled after the caller has found nothing to do,
+//  interrupts are enabled atomically with entering sleep so a wakeup can not
+//  be missed, returns with interrupts enabled
+//
+//  pending deferred handlers are run in place of sleeping
+//
+void timer_idle(void)
+{
+#if TIMER_DEFERRED
+    if (timer_pending_get != timer_pending_put)
+    {
+        // run deferred handlers instead of sleeping
+        irqprof_sei("timer_idle");
+        timer_run_pending();
+
+        return;
+    }
+#endif
+
+    set_sleep_mode(TIMER_SLEEP_MODE);
+    sleep_enable();
+    irqprof_sei("timer_idle");
+    sleep_cpu();
+    sleep_disable();
 }
 
 
@@ -190,13 +1140,21 @@ void timebase_init(void)
     //
 
     // setup the initial timer interrupt
+    timer_compare = TBTIMER_MAX_DELAY;
     TBOCR = TBTIMER_MAX_DELAY;
 
     //
     // initialize timebase
     //
     system_tick = 0;
-    timer_event_list = NULL;
+    timer_queue_init(system_tick);
+
+#if TBSIZE < 64 && TIMER_EPOCH
+    // start the epoch
+    timebase_epoch = 0;
+    init_timer_event(&timebase_epoch_event, TIMEBASE_EPOCH_PERIOD, timebase_epoch_handler);
+    link_timer_event(&timebase_epoch_event);
+#endif
 
     // clear pending timer interrupts
     TBTIFR = _BV(TBOCF);
@@ -1,11 +1,13 @@
 #ifndef _TIMER_H_
 #define _TIMER_H_
 
+#include "mathops.h"
+
 //
 // timebase counter size in bits
 //
 #ifndef TBSIZE
-#error "TBSIZE undefined, set to 16 or 32."
+#error "TBSIZE undefined, set to 16, 32 or 64."
 #endif
 
 //
@@ -20,6 +22,70 @@
 #define TBTIMER_COMP B
 #endif
 
+//
+// timer event queue implementation
+//
+#define TIMER_QUEUE_LIST 0
+#define TIMER_QUEUE_WHEEL 1
+#define TIMER_QUEUE_HEAP 2
+
+#ifndef TIMER_QUEUE
+// default to the sorted list
+#define TIMER_QUEUE TIMER_QUEUE_LIST
+#endif
+
+#if TIMER_QUEUE == TIMER_QUEUE_HEAP
+#ifndef TIMER_HEAP_SIZE
+// timer events the heap can hold
+#define TIMER_HEAP_SIZE 64
+#endif
+
+#if TIMER_HEAP_SIZE > 255
+#error "TIMER_HEAP_SIZE must be no more than 255."
+#endif
+#endif
+
+#ifndef TIMER_EVENT_PREV
+// default to a singly linked list
+#define TIMER_EVENT_PREV 0
+#endif
+
+#ifndef TIMER_DEFERRED
+// default to running all handlers in the compare interrupt
+#define TIMER_DEFERRED 0
+#endif
+
+#ifndef TIMER_SLACK
+// default to expiring every timer event at its own tbtick
+#define TIMER_SLACK 0
+#endif
+
+//
+// deepest sleep mode that keeps the timebase timer clocked, only timer 2 run
+// from the asynchronous oscillator keeps counting in power-save mode
+//
+#ifndef TBTIMER_ASYNC
+#define TBTIMER_ASYNC 0
+#endif
+
+#ifndef TIMER_SLEEP_MODE
+#if TBTIMER == 2 && TBTIMER_ASYNC
+#define TIMER_SLEEP_MODE SLEEP_MODE_PWR_SAVE
+#else
+#define TIMER_SLEEP_MODE SLEEP_MODE_IDLE
+#endif
+#endif
+
+#ifndef TIMER_IDLE_MIN
+// shortest timebase_delay() worth sleeping through
+#define TIMER_IDLE_MIN 8
+#endif
+
+#ifndef TIMER_PENDING_SOFTIRQ
+// default to running deferred handlers at the tail of the compare interrupt
+#define TIMER_PENDING_SOFTIRQ 1
+#endif
+
 
 //
 // types and constants to support the timebase counter
@@ -30,13 +96,58 @@
 #elif TBSIZE == 32
 #define tbtick_t uint32_t
 #define tbtick_st int32_t
+#elif TBSIZE == 64
+#define tbtick_t uint64_t
+#define tbtick_st int64_t
 #else
-#error "Invalid TBSIZE, must be 16 or 32."
+#error "Invalid TBSIZE, must be 16, 32 or 64."
 #endif
 
-#define TIMEBASE_MAX_LATENCY (1L<<(TBSIZE-1))
+#define TIMEBASE_MAX_LATENCY (((tbtick_t) 1)<<(TBSIZE-1))
 #define TIMEBASE_MAX_DELAY (TIMEBASE_MAX_LATENCY-2)
 
+#ifndef TIMER_EPOCH
+// default to no 64-bit extension of a 16 or 32-bit timebase
+#define TIMER_EPOCH 0
+#endif
+
+#ifndef TIMER_HISTOGRAM
+// default to no dispatch latency histograms
+#define TIMER_HISTOGRAM 0
+#endif
+
+#ifndef TIMER_OUTPUT
+// default to no timer events driving the compare output pin
+#define TIMER_OUTPUT 0
+#endif
+
+#if TIMER_OUTPUT && TIMER_SLACK
+#error "TIMER_OUTPUT does not support TIMER_SLACK."
+#endif
+
+#ifndef TIMER_PRIORITY
+// default to dispatching timer events due together in queue order
+#define TIMER_PRIORITY 0
+#endif
+
+#if TIMER_PRIORITY
+#ifndef TIMER_BATCH_SIZE
+// timer events ordered by priority in one pass of the dispatcher
+#define TIMER_BATCH_SIZE 8
+#endif
+
+#ifndef TIMER_BUDGET
+// default to no dispatch budget, ticks, see TIMER_PRIORITY_CRITICAL
+#define TIMER_BUDGET 0
+#endif
+#endif
+
+#if TBSIZE == 64 || TIMER_EPOCH
+#define TIMER_LONG 1
+#else
+#define TIMER_LONG 0
+#endif
+
 //
 // types and constants to support the timebase timer
 //
@@ -55,6 +166,7 @@
 
 #define _TBJOIN2(a,b) a##b
 #define _TBJOIN3(a,b,c) a##b##c
+#define _TBJOIN4(a,b,c,d) a##b##c##d
 #define _TBJOIN5(a,b,c,d,e) a##b##c##d##e
 
 #define _TBTCNT(a,b) _TBJOIN2(TCNT,a)
@@ -78,17 +190,65 @@
 #define TBOCIE _TBOCIE(TBTIMER,TBTIMER_COMP)
 #define TBTIMER_COMP_vect _TBTIMER_COMP_vect(TBTIMER,TBTIMER_COMP)
 
+#define _TBTCCRA(a,b) _TBJOIN3(TCCR,a,A)
+#if TBTIMER == 1
+#define _TBTCCRF(a,b) _TBJOIN3(TCCR,a,C)
+#else
+#define _TBTCCRF(a,b) _TBJOIN3(TCCR,a,B)
+#endif
+#define _TBCOM0(a,b) _TBJOIN4(COM,a,b,0)
+#define _TBCOM1(a,b) _TBJOIN4(COM,a,b,1)
+#define _TBFOC(a,b) _TBJOIN3(FOC,a,b)
+
+#define TBTCCRA _TBTCCRA(TBTIMER,TBTIMER_COMP)
+#define TBTCCRF _TBTCCRF(TBTIMER,TBTIMER_COMP)
+#define TBCOM0 _TBCOM0(TBTIMER,TBTIMER_COMP)
+#define TBCOM1 _TBCOM1(TBTIMER,TBTIMER_COMP)
+#define TBFOC _TBFOC(TBTIMER,TBTIMER_COMP)
+
 
 //
 // timer event
 //
 struct timer_event {
     struct timer_event * next;
+#if TIMER_QUEUE == TIMER_QUEUE_WHEEL
+    struct timer_event ** pprev;
+#elif TIMER_QUEUE == TIMER_QUEUE_HEAP
+    uint8_t index;
+#elif TIMER_EVENT_PREV
+    struct timer_event * prev;
+#endif
     tbtick_t tbtick;
     int8_t (* handler)(struct timer_event * this_timer_event);
+    uint8_t flags;
+#if TIMER_SLACK
+    uint16_t slack;
+#endif
+#if TIMER_PRIORITY
+    uint8_t priority;
+#endif
 };
 
-#define TIMER_EVENT_INIT(name,handler) { &name, 0, handler }
+//
+// timer event flags
+//
+//  TIMER_FLAG_DEFERRED - run the handler outside the compare interrupt, see
+//                        timer_run_pending()
+//
+//  TIMER_FLAG_OUTPUT_SET, TIMER_FLAG_OUTPUT_CLEAR - drive the compare output
+//                        pin high or low in hardware as the timebase reaches
+//                        the tbtick of the timer event, the handler runs the
+//                        tick after like any other, see timer_output_init()
+//
+#define TIMER_FLAG_DEFERRED _BV(0)
+#define TIMER_FLAG_PENDING _BV(1)
+#define TIMER_FLAG_OUTPUT_SET _BV(2)
+#define TIMER_FLAG_OUTPUT_CLEAR _BV(3)
+#define TIMER_FLAG_OUTPUT (TIMER_FLAG_OUTPUT_SET | TIMER_FLAG_OUTPUT_CLEAR)
+#define TIMER_FLAG_DUE _BV(4)
+
+#define TIMER_EVENT_INIT(name,func) { .next = &name, .tbtick = 0, .handler = func, .flags = 0 }
 #define TIMER_EVENT(name,handler)                                              \
         int8_t handler(struct timer_event * this_timer_event);                 \
         struct timer_event name = TIMER_EVENT_INIT(name,handler)
@@ -98,33 +258,309 @@ struct timer_event {
         (a)->next = (a);                                                       \
         (a)->tbtick = (b);                                                     \
         (a)->handler = (c);                                                    \
+        (a)->flags = 0;                                                        \
+        init_timer_slack(a);                                                   \
+        init_timer_priority(a);                                                \
     } while (0)
 
-#define F_TBTIMER (F_CPU / TBTIMER_PRESCALER)
+//
+// timer slack, a timer event may be expired up to slack ticks after its tbtick
+// so that it can share the interrupt of another timer event
+//
+#if TIMER_SLACK
+#define init_timer_slack(a) do {(a)->slack = 0;} while (0)
+#define set_timer_slack(a,b) do {(a)->slack = (b);} while (0)
+#else
+#define init_timer_slack(a) do {} while (0)
+#define set_timer_slack(a,b) do {} while (0)
+#endif
 
-#define TBTICKS_FROM_MS(a) ((tbtick_t) (a) * (F_TBTIMER / 1000))
-#if TBTIMER == 1
-#define TBTICKS_FROM_US(a) (((a) + 3) >> 2)
+//
+// timer event priority, timer events due in the same pass of the dispatcher
+// run highest priority first and in queue order within a priority
+//
+//  with a TIMER_BUDGET, once a pass has run for TIMER_BUDGET ticks timer
+//  events below TIMER_PRIORITY_CRITICAL are left in the queue for the next
+//  pass, letting other interrupts in
+//
+#define TIMER_PRIORITY_LOW 0
+#define TIMER_PRIORITY_NORMAL 64
+#define TIMER_PRIORITY_CRITICAL 128
+
+#if TIMER_PRIORITY
+#define init_timer_priority(a) do {(a)->priority = TIMER_PRIORITY_LOW;} while (0)
+#define set_timer_priority(a,b) do {(a)->priority = (b);} while (0)
 #else
-#define TBTICKS_FROM_US(a) (((a) + 7) >> 3)
+#define init_timer_priority(a) do {} while (0)
+#define set_timer_priority(a,b) do {} while (0)
 #endif
 
+#define F_TBTIMER (F_CPU / TBTIMER_PRESCALER)
+
+//
+// timebase tick conversions
+//
+//  each conversion scales by a ratio of compile time constants, num / den, as
+//  a multiply by the whole part plus a 32 by 32-bit multiply by the fraction
+//  in 0.32 fixed point, there are no runtime divisions and a constant argument
+//  folds to a constant
+//
+//  a constant argument takes the 64-bit form, which folds, a runtime argument
+//  takes the 0.32 fraction multiply as four 16 by 16-bit multiplies summed
+//  into the upper 32 bits of the product, the same result without 64-bit
+//  arithmetic
+//
+//  delays converted to ticks are rounded up so a timer event is never early,
+//  to within a tick for a ratio not exact in 32 fractional bits, times
+//  converted from ticks are rounded to nearest, arguments are limited to 32
+//  bits
+//
+#define _TBCONV_INT(num,den) ((num) / (den))
+#define _TBCONV_FRAC(num,den,round)                                            \
+    ((uint32_t) (((((uint64_t) ((num) % (den))) << 32) + (round)) / (den)))
+#define _TBCONV_ROUND(type,a,num,den,fround,round)                             \
+    ((type) ((type) (uint32_t) (a) * (type) _TBCONV_INT(num,den) +             \
+             (type) (__builtin_constant_p(a) ?                                 \
+                     (uint32_t) (((uint64_t) (uint32_t) (a) *                  \
+                                  _TBCONV_FRAC(num,den,fround) +               \
+                                  (round)) >> 32) :                            \
+                     _tbconv_mulhi((a), _TBCONV_FRAC(num,den,fround),          \
+                                   (round)))))
+
+//
+// upper 32 bits of a * frac + round
+//
+static inline uint32_t _tbconv_mulhi(uint32_t a, uint32_t frac, uint32_t round)
+{
+    uint32_t ll = _mulu((uint16_t) a, (uint16_t) frac);
+    uint32_t lh = _mulu((uint16_t) a, (uint16_t) (frac >> 16));
+    uint32_t hl = _mulu((uint16_t) (a >> 16), (uint16_t) frac);
+    uint32_t hh = _mulu((uint16_t) (a >> 16), (uint16_t) (frac >> 16));
+    uint32_t lo = ll + round;
+
+    // the carries out of the low word and of the sum of the middle words
+    return hh + (lh >> 16) + (hl >> 16) + (lo < ll) +
+           (((lo >> 16) + (uint16_t) lh + (uint16_t) hl) >> 16);
+}
+
+// rounded to nearest
+#define _TBCONV(type,a,num,den)                                                \
+    _TBCONV_ROUND(type,a,num,den,(den) / 2,0x80000000UL)
+
+// rounded up
+#define _TBCONV_UP(type,a,num,den)                                             \
+    _TBCONV_ROUND(type,a,num,den,(den) - 1,0xffffffffUL)
+
+#define TBTICKS_FROM_S(a) _TBCONV_UP(tbtick_t, a, F_CPU, TBTIMER_PRESCALER)
+#define TBTICKS_FROM_MS(a) _TBCONV_UP(tbtick_t, a, F_CPU, TBTIMER_PRESCALER * 1000UL)
+#define TBTICKS_FROM_US(a) _TBCONV_UP(tbtick_t, a, F_CPU, TBTIMER_PRESCALER * 1000000UL)
+
+#define S_FROM_TBTICKS(a) _TBCONV(uint32_t, a, TBTIMER_PRESCALER, F_CPU)
+#define MS_FROM_TBTICKS(a) _TBCONV(uint32_t, a, TBTIMER_PRESCALER * 1000UL, F_CPU)
+#define US_FROM_TBTICKS(a) _TBCONV(uint32_t, a, TBTIMER_PRESCALER * 1000000UL, F_CPU)
+
+_Static_assert((F_CPU / TBTIMER_PRESCALER) >= 1000UL,
+               "Timebase tick longer than 1 ms.");
+_Static_assert((tbtick_t) (TBTICKS_FROM_MS(1000UL) - TBTICKS_FROM_S(1)) <= 1,
+               "TBTICKS_FROM_MS() not accurate to one tick per second.");
+_Static_assert((tbtick_t) (TBTICKS_FROM_US(1000000UL) - TBTICKS_FROM_S(1)) <= 1,
+               "TBTICKS_FROM_US() not accurate to one tick per second.");
+_Static_assert((TBSIZE > 32) || (((uint64_t) TIMEBASE_MAX_DELAY * TBTIMER_PRESCALER * 1000UL / F_CPU) <= UINT32_MAX),
+               "MS_FROM_TBTICKS() can not hold TIMEBASE_MAX_DELAY.");
+
 #define timer_is_expired(a) (((volatile struct timer_event *) (a))->next == (a))
 
 
+#if TIMER_LONG
+//
+// long timer event
+//
+//  a timer event with a 64-bit tbtick, delays beyond TIMEBASE_MAX_DELAY are
+//  covered by re-arming the embedded timer event internally, the handler is
+//  only called once the full delay has passed
+//
+struct long_timer_event {
+    struct timer_event timer_event;
+    uint64_t tbtick;
+    int8_t (* handler)(struct long_timer_event * this_long_timer_event);
+};
+
+#define init_long_timer_event(a,b,c)                                           \
+    do {                                                                       \
+        init_timer_event(&(a)->timer_event, 0, NULL);                          \
+        (a)->tbtick = (b);                                                     \
+        (a)->handler = (c);                                                    \
+    } while (0)
+
+#define long_timer_is_expired(a) timer_is_expired(&(a)->timer_event)
+#endif
+
+
+//
+// periodic timer event
+//
+//  a timer event re-armed every period ticks from its first tbtick, period
+//  must not be zero, the handler returns non-zero to keep it running
+//
+//  when the next tbtick has already passed once the handler returns, after a
+//  long interrupts disabled section or a slow handler, overruns is counted
+//  and policy selects the next tbtick
+//
+//    TIMER_PERIODIC_CATCHUP - keep the phase, run the missed periods back to
+//                             back
+//    TIMER_PERIODIC_SKIP    - keep the phase, drop the missed periods
+//    TIMER_PERIODIC_RESYNC  - restart the period from now
+//
+//  the period is period + period_frac / 65536 ticks, the fraction is summed
+//  in phase_frac and each carry lengthens a period by one tick so the long
+//  term rate is exact and every tbtick is within one tick of the ideal
+//
+struct periodic_timer_event {
+    struct timer_event timer_event;
+    tbtick_t period;
+    uint16_t period_frac;
+    uint16_t phase_frac;
+    uint8_t policy;
+    uint16_t overruns;
+    int8_t (* handler)(struct periodic_timer_event * this_periodic_timer_event);
+};
+
+#define TIMER_PERIODIC_CATCHUP 0
+#define TIMER_PERIODIC_SKIP 1
+#define TIMER_PERIODIC_RESYNC 2
+
+#define init_periodic_timer_event(a,b,c,d,e)                                   \
+    do {                                                                       \
+        init_timer_event(&(a)->timer_event, (b), periodic_timer_handler);      \
+        (a)->period = (c);                                                     \
+        (a)->period_frac = 0;                                                  \
+        (a)->phase_frac = 0;                                                   \
+        (a)->policy = (d);                                                     \
+        (a)->overruns = 0;                                                     \
+        (a)->handler = (e);                                                    \
+    } while (0)
+
+#define set_periodic_timer_frac(a,b) do {(a)->period_frac = (b);} while (0)
+
+#define periodic_timer_is_expired(a) timer_is_expired(&(a)->timer_event)
+
+//
+// period of a rate of num / den Hz, whole ticks and 1/65536 tick fraction,
+// num * TBTIMER_PRESCALER must fit in 32 bits
+//
+#define _TBPERIOD_DEN(num) ((uint32_t) TBTIMER_PRESCALER * (num))
+#define TBPERIOD_FROM_RATE(num,den)                                            \
+    ((tbtick_t) (((uint64_t) F_CPU * (den)) / _TBPERIOD_DEN(num)))
+#define TBPERIOD_FRAC_FROM_RATE(num,den)                                       \
+    ((uint16_t) (((((uint64_t) F_CPU * (den)) % _TBPERIOD_DEN(num) << 16) +   \
+                  _TBPERIOD_DEN(num) / 2) / _TBPERIOD_DEN(num)))
+
+#define TBPERIOD_FROM_HZ(a) TBPERIOD_FROM_RATE(a, 1)
+#define TBPERIOD_FRAC_FROM_HZ(a) TBPERIOD_FRAC_FROM_RATE(a, 1)
+
+
+#if TIMER_SLACK
+//
+// timer statistics
+//
+//  coalesced counts the timer events expired ahead of their latest expiry in
+//  the interrupt of another timer event, each is a compare interrupt avoided
+//
+struct timer_stats {
+    uint32_t interrupts;
+    uint32_t expired;
+    uint32_t coalesced;
+};
+#endif
+
+
+#if TIMER_HISTOGRAM
+//
+// dispatch latency histograms
+//
+//  lateness is the timebase less tbtick when the handler of a timer event is
+//  run, by the compare interrupt or for a deferred timer event by
+//  timer_run_pending(), at least 1 as a timer event expires once its tbtick
+//  has passed, run time is the ticks spent in the handler, both are counted
+//  in log2 buckets, bucket 0 holds 0 and bucket n holds 2^(n-1) to 2^n-1, the
+//  last bucket also holds everything larger
+//
+//  slowest is the handler of the longest run time seen, printed as its
+//  program memory word address
+//
+#ifndef TIMER_HISTOGRAM_BUCKETS
+#define TIMER_HISTOGRAM_BUCKETS 16
+#endif
+
+struct timer_histogram {
+    uint32_t count;
+    tbtick_t min;
+    tbtick_t max;
+    uint16_t bucket[TIMER_HISTOGRAM_BUCKETS];
+};
+
+struct timer_latency {
+    struct timer_histogram lateness;
+    struct timer_histogram run_time;
+    int8_t (* slowest)(struct timer_event * this_timer_event);
+};
+#endif
+
+
 //
 // timebase api
 //
+//  interrupt handlers that access a 16-bit register of the timebase timer
+//  must call timebase_touch() so that timebase_now() retries a torn read,
+//  timebase_get() and timebase_now() called with interrupts disabled do so
+//  themselves
+//
+extern volatile uint8_t timebase_gen;
+
+#define timebase_touch() do {timebase_gen++;} while (0)
+
 void timebase_init(void);
 tbtimer_t timebase_get(void);
+tbtick_t timebase_now(void);
+#if TBSIZE == 64
+#define timebase_now64() timebase_now()
+#elif TIMER_EPOCH
+uint64_t timebase_now64(void);
+#endif
 void timebase_delay(tbtimer_st tbticks);
 
 
 //
 // timer event api
 //
-void schedule_timer_event(struct timer_event * this_timer_event, struct timer_event * ref_timer_event);
+int8_t schedule_timer_event(struct timer_event * this_timer_event, struct timer_event * ref_timer_event);
+int8_t reschedule_timer_event(struct timer_event * this_timer_event, tbtick_t tbtick, struct timer_event * ref_timer_event);
 void cancel_timer_event(struct timer_event * this_timer_event);
 void timer_delay(tbtick_st ticks);
+#if TIMER_LONG
+void schedule_long_timer_event(struct long_timer_event * this_long_timer_event, struct long_timer_event * ref_long_timer_event);
+#define cancel_long_timer_event(a) cancel_timer_event(&(a)->timer_event)
+#endif
+int8_t periodic_timer_handler(struct timer_event * this_timer_event);
+#define schedule_periodic_timer_event(a,b) schedule_timer_event(&(a)->timer_event, (b))
+#define cancel_periodic_timer_event(a) cancel_timer_event(&(a)->timer_event)
+void timer_idle(void);
+#if TIMER_OUTPUT
+void timer_output_init(uint8_t level);
+#endif
+#if TIMER_DEFERRED
+void timer_run_pending(void);
+#endif
+#if TIMER_SLACK
+void timer_get_stats(struct timer_stats * stats);
+#endif
+#if TIMER_QUEUE == TIMER_QUEUE_HEAP
+uint16_t timer_get_overflows(void);
+#endif
+#if TIMER_HISTOGRAM
+void timer_get_latency(struct timer_latency * latency);
+void timer_clear_latency(void);
+void timer_print_latency(void);
+#endif
 
 #endif // _TIMER_H_
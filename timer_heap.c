@@ -0,0 +1,227 @@
+#include <stddef.h>
+#include <util/atomic.h>
+
+#include "project.h"
+#include "timer.h"
+
+#if TIMER_QUEUE == TIMER_QUEUE_HEAP
+
+#include "timer_queue.h"
+
+//
+// binary min-heap of pending timer events
+//
+//  the heap is an array of timer event pointers, the earliest timer event is
+//  at the root and each timer event records its own position in the array so
+//  it can be unlinked or moved after a change of tbtick in O(log n)
+//
+//  the array is statically sized by TIMER_HEAP_SIZE, a timer event linked
+//  when the heap is full can not be queued, it is left expired, which
+//  schedule_timer_event() returns as an error, and counted, see
+//  timer_get_overflows()
+//
+//  timer events sharing a tick are dispatched in no particular order
+//
+static struct timer_event * timer_heap[TIMER_HEAP_SIZE];
+static uint8_t timer_heap_count;
+static uint16_t timer_heap_overflows;
+
+#define timer_event_before(a,b) ((tbtick_st) (timer_event_key(a) - timer_event_key(b)) < 0)
+
+
+static inline void heap_put(uint8_t index, struct timer_event * this_timer_event)
+{
+    timer_heap[index] = this_timer_event;
+    this_timer_event->index = index;
+}
+
+
+//
+// move a timer event toward the root until its parent is not later
+//
+static void sift_up(uint8_t index, struct timer_event * this_timer_event)
+{
+    while (index)
+    {
+        uint8_t parent = (index - 1) >> 1;
+
+        if (!timer_event_before(this_timer_event, timer_heap[parent]))
+        {
+            break;
+        }
+
+        heap_put(index, timer_heap[parent]);
+        index = parent;
+    }
+
+    heap_put(index, this_timer_event);
+}
+
+
+//
+// move a timer event away from the root until neither child is earlier
+//
+static void sift_down(uint8_t index, struct timer_event * this_timer_event)
+{
+    for (;;)
+    {
+        // wider than index, the children of index 127 on are past 255
+        uint16_t child = ((uint16_t) index << 1) + 1;
+
+        if (child >= timer_heap_count)
+        {
+            break;
+        }
+
+        if (((child + 1) < timer_heap_count) &&
+            timer_event_before(timer_heap[child + 1], timer_heap[child]))
+        {
+            child++;
+        }
+
+        if (!timer_event_before(timer_heap[child], this_timer_event))
+        {
+            break;
+        }
+
+        heap_put(index, timer_heap[child]);
+        index = child;
+    }
+
+    heap_put(index, this_timer_event);
+}
+
+
+//
+// restore heap order around a timer event placed at index
+//
+static void sift(uint8_t index, struct timer_event * this_timer_event)
+{
+    if (index && timer_event_before(this_timer_event, timer_heap[(index - 1) >> 1]))
+    {
+        sift_up(index, this_timer_event);
+    }
+    else
+    {
+        sift_down(index, this_timer_event);
+    }
+}
+
+
+//
+// remove the timer event at index, the last timer event fills the hole
+//
+static void heap_remove(uint8_t index)
+{
+    struct timer_event * last_timer_event;
+
+    last_timer_event = timer_heap[--timer_heap_count];
+
+    if (index < timer_heap_count)
+    {
+        sift(index, last_timer_event);
+    }
+}
+
+
+void timer_queue_init(tbtick_t tbtick)
+{
+    timer_heap_count = 0;
+}
+
+
+void link_timer_event(struct timer_event * this_timer_event)
+{
+    if (timer_heap_count >= TIMER_HEAP_SIZE)
+    {
+        // heap is full, leave the timer event expired
+        this_timer_event->next = this_timer_event;
+
+        if (timer_heap_overflows != UINT16_MAX)
+        {
+            timer_heap_overflows++;
+        }
+
+        return;
+    }
+
+    this_timer_event->next = NULL;
+
+    sift_up(timer_heap_count++, this_timer_event);
+}
+
+
+//
+// number of timer events the full heap could not queue, saturating
+//
+uint16_t timer_get_overflows(void)
+{
+    uint16_t overflows;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        overflows = timer_heap_overflows;
+    }
+
+    return overflows;
+}
+
+
+void unlink_timer_event(struct timer_event * this_timer_event)
+{
+    if (this_timer_event->next != this_timer_event)
+    {
+        heap_remove(this_timer_event->index);
+    }
+
+    this_timer_event->next = this_timer_event;
+}
+
+
+void relink_timer_event(struct timer_event * this_timer_event)
+{
+    if (this_timer_event->next != this_timer_event)
+    {
+        sift(this_timer_event->index, this_timer_event);
+    }
+    else
+    {
+        link_timer_event(this_timer_event);
+    }
+}
+
+
+struct timer_event * expire_timer_event(tbtick_t tbtick, tbtick_st * delta)
+{
+    struct timer_event * this_timer_event;
+
+    if (timer_heap_count == 0)
+    {
+        // no pending timer events
+        *delta = TBTIMER_MAX_DELAY;
+
+        return NULL;
+    }
+
+    this_timer_event = timer_heap[0];
+
+    *delta = timer_event_key(this_timer_event) - tbtick;
+
+    if (!timer_event_due(this_timer_event, tbtick))
+    {
+        return NULL;
+    }
+
+    heap_remove(0);
+    this_timer_event->next = this_timer_event;
+
+    return this_timer_event;
+}
+
+
+struct timer_event * peek_timer_event(void)
+{
+    return (timer_heap_count) ? (timer_heap[0]) : (NULL);
+}
+
+#endif // TIMER_QUEUE == TIMER_QUEUE_HEAP
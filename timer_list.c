@@ -0,0 +1,191 @@
+#include <stddef.h>
+
+#include "project.h"
+#include "timer.h"
+
+#if TIMER_QUEUE == TIMER_QUEUE_LIST
+
+#include "timer_queue.h"
+
+//
+// sorted list of pending timer events, earliest first
+//
+//  with TIMER_EVENT_PREV the list is doubly linked, timer events are unlinked
+//  in constant time and linked by searching back from the tail, so a timer
+//  event re-armed past every other pending timer event, a watchdog timeout or
+//  a periodic timer, is also linked in constant time
+//
+static struct timer_event * timer_event_list;
+#if TIMER_EVENT_PREV
+static struct timer_event * timer_event_tail;
+#endif
+
+
+void timer_queue_init(tbtick_t tbtick)
+{
+    timer_event_list = NULL;
+#if TIMER_EVENT_PREV
+    timer_event_tail = NULL;
+#endif
+}
+
+
+#if TIMER_EVENT_PREV
+
+void link_timer_event(struct timer_event * this_timer_event)
+{
+    struct timer_event * prev_timer_event;
+
+    for ( prev_timer_event  = timer_event_tail;
+          prev_timer_event != NULL;
+          prev_timer_event  = prev_timer_event->prev)
+    {
+        if ((tbtick_st) (timer_event_key(this_timer_event) - timer_event_key(prev_timer_event)) >= 0)
+        {
+            break;
+        }
+    }
+
+    this_timer_event->prev = prev_timer_event;
+
+    if (prev_timer_event)
+    {
+        this_timer_event->next = prev_timer_event->next;
+        prev_timer_event->next = this_timer_event;
+    }
+    else
+    {
+        this_timer_event->next = timer_event_list;
+        timer_event_list = this_timer_event;
+    }
+
+    if (this_timer_event->next)
+    {
+        this_timer_event->next->prev = this_timer_event;
+    }
+    else
+    {
+        timer_event_tail = this_timer_event;
+    }
+}
+
+
+void unlink_timer_event(struct timer_event * this_timer_event)
+{
+    if (this_timer_event->next != this_timer_event)
+    {
+        if (this_timer_event->prev)
+        {
+            this_timer_event->prev->next = this_timer_event->next;
+        }
+        else
+        {
+            timer_event_list = this_timer_event->next;
+        }
+
+        if (this_timer_event->next)
+        {
+            this_timer_event->next->prev = this_timer_event->prev;
+        }
+        else
+        {
+            timer_event_tail = this_timer_event->prev;
+        }
+    }
+
+    this_timer_event->next = this_timer_event;
+}
+
+#else // TIMER_EVENT_PREV
+
+void link_timer_event(struct timer_event * this_timer_event)
+{
+    struct timer_event ** tthis_timer_event;
+
+    for ( tthis_timer_event  = &timer_event_list;
+         *tthis_timer_event != NULL;
+          tthis_timer_event  = &((*tthis_timer_event)->next))
+    {
+        if ((tbtick_st) (timer_event_key(this_timer_event) - timer_event_key(*tthis_timer_event)) < 0)
+        {
+            break;
+        }
+    }
+
+    this_timer_event->next = *tthis_timer_event;
+    *tthis_timer_event = this_timer_event;
+}
+
+
+void unlink_timer_event(struct timer_event * this_timer_event)
+{
+    struct timer_event ** tthis_timer_event;
+
+    for ( tthis_timer_event  = &timer_event_list;
+         *tthis_timer_event != NULL;
+          tthis_timer_event  = &((*tthis_timer_event)->next))
+    {
+        if (*tthis_timer_event == this_timer_event)
+        {
+            *tthis_timer_event = this_timer_event->next;
+            break;
+        }
+    }
+
+    this_timer_event->next = this_timer_event;
+}
+
+#endif // TIMER_EVENT_PREV
+
+
+void relink_timer_event(struct timer_event * this_timer_event)
+{
+    unlink_timer_event(this_timer_event);
+    link_timer_event(this_timer_event);
+}
+
+
+struct timer_event * expire_timer_event(tbtick_t tbtick, tbtick_st * delta)
+{
+    struct timer_event * this_timer_event;
+
+    this_timer_event = timer_event_list;
+
+    if (this_timer_event == NULL)
+    {
+        // no pending timer events
+        *delta = TBTIMER_MAX_DELAY;
+
+        return NULL;
+    }
+
+    *delta = timer_event_key(this_timer_event) - tbtick;
+
+    if (!timer_event_due(this_timer_event, tbtick))
+    {
+        return NULL;
+    }
+
+    timer_event_list = this_timer_event->next;
+#if TIMER_EVENT_PREV
+    if (timer_event_list)
+    {
+        timer_event_list->prev = NULL;
+    }
+    else
+    {
+        timer_event_tail = NULL;
+    }
+#endif
+    this_timer_event->next = this_timer_event;
+
+    return this_timer_event;
+}
+
+
+struct timer_event * peek_timer_event(void)
+{
+    return timer_event_list;
+}
+
+#endif // TIMER_QUEUE == TIMER_QUEUE_LIST
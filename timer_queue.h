@@ -0,0 +1,69 @@
+#ifndef _TIMER_QUEUE_H_
+#define _TIMER_QUEUE_H_
+
+//
+// timer event queue
+//
+//  the timer event queue holds the pending timer events in expiry order, the
+//  implementation is selected at compile time by TIMER_QUEUE
+//
+//    TIMER_QUEUE_LIST  - sorted singly linked list, timer_list.c
+//    TIMER_QUEUE_WHEEL - hierarchical timing wheel, timer_wheel.c
+//    TIMER_QUEUE_HEAP  - binary min-heap, timer_heap.c
+//
+//  all queue functions are called with interrupts disabled
+//
+//  the queue is ordered by the latest expiry of each timer event, its tbtick
+//  plus any slack, but a timer event may be expired as soon as its tbtick has
+//  passed, letting it share the interrupt of an earlier timer event
+//
+#if TIMER_SLACK
+#define timer_event_key(a) ((tbtick_t) ((a)->tbtick + (a)->slack))
+#else
+#define timer_event_key(a) ((a)->tbtick)
+#endif
+
+#define timer_event_due(a,b) ((tbtick_st) ((a)->tbtick - (b)) < 0)
+
+//
+// initialize an empty queue, tbtick is the current timebase
+//
+void timer_queue_init(tbtick_t tbtick);
+
+//
+// add a timer event to the queue
+//
+void link_timer_event(struct timer_event * this_timer_event);
+
+//
+// remove a timer event from the queue, the timer event is marked expired
+//
+void unlink_timer_event(struct timer_event * this_timer_event);
+
+//
+// restore the queue order of a timer event after its tbtick has changed, a
+// timer event not in the queue is added
+//
+void relink_timer_event(struct timer_event * this_timer_event);
+
+//
+// remove and return the next timer event expired at tbtick, the timer event is
+// marked expired
+//
+//  if no timer event has expired NULL is returned and delta is set to the
+//  number of ticks until the queue next needs service, the latest expiry of
+//  the next timer event, or to -1 when the queue has left work for the next
+//  tick to bound the time spent in one call
+//
+struct timer_event * expire_timer_event(tbtick_t tbtick, tbtick_st * delta);
+
+//
+// return the pending timer event with the earliest expiry or NULL, called
+// after expire_timer_event() has returned NULL
+//
+//  a queue that cannot find it without a search returns NULL when the service
+//  point it last reported is not the expiry of a timer event
+//
+struct timer_event * peek_timer_event(void);
+
+#endif // _TIMER_QUEUE_H_
@@ -0,0 +1,422 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "project.h"
+#include "timer.h"
+
+#if TIMER_QUEUE == TIMER_QUEUE_WHEEL
+
+#include "timer_queue.h"
+
+//
+// hierarchical timing wheel
+//
+//  the near wheel has one slot per tick and holds the timer events expiring
+//  in the next TVR_SIZE ticks, each outer wheel has TVN_SIZE slots and each of
+//  its slots spans a full turn of the wheel below it, enough outer wheels are
+//  used to cover the full range of tbtick_t
+//
+//  when the near wheel turns over the next slot of the first outer wheel is
+//  cascaded, its timer events are relinked into the near wheel, when that
+//  outer wheel turns over the next outer wheel is cascaded and so on
+//
+//  each slot is a list of timer events linked through next and pprev so
+//  timer events are linked and unlinked in constant time, an occupancy bitmap
+//  and its summary let empty slots be skipped 64 at a time
+//
+//  timer events sharing a tick are dispatched in no particular order
+//
+#if TBSIZE > 32
+#error "Timing wheel supports TBSIZE of 16 or 32."
+#endif
+
+#ifndef TIMER_WHEEL_BITS
+#define TIMER_WHEEL_BITS 8
+#endif
+
+//
+// cascades per expire_timer_event() call, catching up after a long sleep
+// jumps from one cascade to the next, the cascades past this are left for
+// the interrupt of the next tick to bound the time spent with interrupts
+// disabled
+//
+#ifndef TIMER_WHEEL_CASCADES
+#define TIMER_WHEEL_CASCADES 4
+#endif
+
+#define TVR_BITS (TIMER_WHEEL_BITS)
+#define TVN_BITS (6)
+#define TVR_SIZE (1 << TVR_BITS)
+#define TVN_SIZE (1 << TVN_BITS)
+#define TVR_MASK (TVR_SIZE - 1)
+#define TVN_MASK (TVN_SIZE - 1)
+#define TVN_LEVELS ((TBSIZE - TVR_BITS + TVN_BITS - 1) / TVN_BITS)
+
+// slots of the outermost wheel within the range of tbtick_t
+#define TVT_SIZE (1L << (TBSIZE - TVR_BITS - (TVN_LEVELS - 1) * TVN_BITS))
+
+#define WHEEL_SLOTS (TVR_SIZE + TVN_LEVELS * TVN_SIZE)
+
+//
+// wheel_tick lags the timebase by up to the last delay returned, a timer event
+// linked up to TIMEBASE_MAX_DELAY ahead of the timebase must still be placed
+// ahead of wheel_tick, so the lag is kept under a quarter turn of tbtick_t and
+// only timer events less than a quarter turn behind wheel_tick are expired
+//
+#define WHEEL_LATE (((tbtick_t) 1) << (TBSIZE - 2))
+#define WHEEL_MAX_DELAY ((uint32_t) WHEEL_LATE - TVR_SIZE)
+
+//
+// next tick to be processed, all slots before it have been processed
+//
+static tbtick_t wheel_tick;
+
+//
+// near wheel slots followed by the outer wheel slots
+//
+static struct timer_event * wheel[WHEEL_SLOTS];
+
+//
+// slot occupancy, a set bit may refer to a slot emptied by unlink, and a
+// summary of one bit per occupancy byte, set while the byte may be non-zero
+//
+static uint8_t wheel_map[WHEEL_SLOTS / 8];
+static uint8_t wheel_sum[(WHEEL_SLOTS + 63) / 64];
+
+#define wheel_set(a)                                                           \
+    do {                                                                       \
+        wheel_map[(a) >> 3] |= _BV((a) & 7);                                   \
+        wheel_sum[(a) >> 6] |= _BV(((a) >> 3) & 7);                            \
+    } while (0)
+
+#define wheel_clr(a)                                                           \
+    do {                                                                       \
+        if (!(wheel_map[(a) >> 3] &= ~_BV((a) & 7)))                           \
+        {                                                                      \
+            wheel_sum[(a) >> 6] &= ~_BV(((a) >> 3) & 7);                       \
+        }                                                                      \
+    } while (0)
+
+
+//
+// find the first occupied slot in [from, to), returns to if none
+//
+static uint16_t wheel_find(uint16_t from, uint16_t to)
+{
+    while (from < to)
+    {
+        uint8_t bits = wheel_map[from >> 3] >> (from & 7);
+
+        if (bits)
+        {
+            while (!(bits & 1))
+            {
+                bits >>= 1;
+                from++;
+            }
+
+            return (from < to) ? from : to;
+        }
+
+        from = (from | 7) + 1;
+
+        // skip empty occupancy bytes
+        bits = wheel_sum[from >> 6] >> ((from >> 3) & 7);
+
+        if (bits)
+        {
+            while (!(bits & 1))
+            {
+                bits >>= 1;
+                from += 8;
+            }
+        }
+        else
+        {
+            from = (from | 63) + 1;
+        }
+    }
+
+    return to;
+}
+
+
+void timer_queue_init(tbtick_t tbtick)
+{
+    wheel_tick = tbtick;
+
+    memset(wheel, 0, sizeof(wheel));
+    memset(wheel_map, 0, sizeof(wheel_map));
+    memset(wheel_sum, 0, sizeof(wheel_sum));
+}
+
+
+void link_timer_event(struct timer_event * this_timer_event)
+{
+    tbtick_t key = timer_event_key(this_timer_event);
+    tbtick_t idx = key - wheel_tick;
+    uint16_t slot;
+
+    if ((tbtick_t) (idx + WHEEL_LATE) < WHEEL_LATE)
+    {
+        // already expired, add to the next slot processed
+        slot = wheel_tick & TVR_MASK;
+    }
+    else if (idx < TVR_SIZE)
+    {
+        slot = key & TVR_MASK;
+    }
+    else
+    {
+        uint8_t shift = TVR_BITS;
+
+        // find the outer wheel spanning idx
+        for (slot = TVR_SIZE; slot < (WHEEL_SLOTS - TVN_SIZE); slot += TVN_SIZE)
+        {
+            if ((idx >> (shift + TVN_BITS)) == 0)
+            {
+                break;
+            }
+
+            shift += TVN_BITS;
+        }
+
+        slot += (key >> shift) & TVN_MASK;
+    }
+
+    this_timer_event->next = wheel[slot];
+    if (this_timer_event->next)
+    {
+        this_timer_event->next->pprev = &this_timer_event->next;
+    }
+
+    wheel[slot] = this_timer_event;
+    this_timer_event->pprev = &wheel[slot];
+
+    wheel_set(slot);
+}
+
+
+void unlink_timer_event(struct timer_event * this_timer_event)
+{
+    if (this_timer_event->next != this_timer_event)
+    {
+        *this_timer_event->pprev = this_timer_event->next;
+
+        if (this_timer_event->next)
+        {
+            this_timer_event->next->pprev = this_timer_event->pprev;
+        }
+    }
+
+    this_timer_event->next = this_timer_event;
+}
+
+
+void relink_timer_event(struct timer_event * this_timer_event)
+{
+    unlink_timer_event(this_timer_event);
+    link_timer_event(this_timer_event);
+}
+
+
+//
+// remove the first timer event of a near wheel slot, it is marked expired
+//
+static struct timer_event * wheel_pop(uint16_t slot)
+{
+    struct timer_event * this_timer_event = wheel[slot];
+
+    wheel[slot] = this_timer_event->next;
+    if (this_timer_event->next)
+    {
+        this_timer_event->next->pprev = &wheel[slot];
+    }
+
+    this_timer_event->next = this_timer_event;
+
+    return this_timer_event;
+}
+
+
+//
+// relink the timer events of the outer wheel slots that become current when
+// the near wheel turns over
+//
+static void cascade_timer_events(void)
+{
+    uint16_t slot;
+    uint8_t shift = TVR_BITS;
+
+    for (slot = TVR_SIZE; slot < WHEEL_SLOTS; slot += TVN_SIZE)
+    {
+        uint8_t index = (wheel_tick >> shift) & TVN_MASK;
+        struct timer_event * this_timer_event;
+
+        this_timer_event = wheel[slot + index];
+        wheel[slot + index] = NULL;
+        wheel_clr(slot + index);
+
+        while (this_timer_event)
+        {
+            struct timer_event * next_timer_event = this_timer_event->next;
+
+            link_timer_event(this_timer_event);
+            this_timer_event = next_timer_event;
+        }
+
+        if (index)
+        {
+            // this wheel did not turn over
+            break;
+        }
+
+        shift += TVN_BITS;
+    }
+}
+
+
+//
+// ticks from wheel_tick until the wheel next needs service, either the first
+// occupied near wheel slot or the cascade of the first occupied outer slot,
+// the search stops at limit ticks
+//
+static uint32_t wheel_next(uint32_t limit)
+{
+    uint16_t index = wheel_tick & TVR_MASK;
+    uint16_t slot;
+    uint16_t next;
+    uint32_t ticks;
+    uint8_t shift;
+
+    next = wheel_find(index, TVR_SIZE);
+    if (next < TVR_SIZE)
+    {
+        return next - index;
+    }
+
+    // ticks until the near wheel turns over
+    ticks = TVR_SIZE - index;
+    if (wheel_find(0, index) < index)
+    {
+        return ticks;
+    }
+
+    shift = TVR_BITS;
+
+    for (slot = TVR_SIZE; slot < WHEEL_SLOTS; slot += TVN_SIZE)
+    {
+        uint16_t size = (slot < (WHEEL_SLOTS - TVN_SIZE)) ? TVN_SIZE : TVT_SIZE;
+
+        if (ticks > limit)
+        {
+            break;
+        }
+
+        index = (wheel_tick >> shift) & TVN_MASK;
+
+        next = wheel_find(slot + index + 1, slot + size);
+        if (next < slot + size)
+        {
+            return ticks + ((uint32_t) (next - slot - index - 1) << shift);
+        }
+
+        // ticks until this wheel turns over
+        ticks += (uint32_t) (size - 1 - index) << shift;
+        if (wheel_find(slot, slot + index + 1) < slot + index + 1)
+        {
+            return ticks;
+        }
+
+        shift += TVN_BITS;
+    }
+
+    return limit;
+}
+
+
+struct timer_event * expire_timer_event(tbtick_t tbtick, tbtick_st * delta)
+{
+    uint16_t index;
+    uint32_t ticks;
+    uint8_t cascades = 0;
+
+    for (;;)
+    {
+        struct timer_event * this_timer_event;
+        tbtick_t steps;
+
+        index = wheel_tick & TVR_MASK;
+        this_timer_event = wheel[index];
+
+        if (this_timer_event && timer_event_due(this_timer_event, tbtick))
+        {
+            // current slot holds an expired timer event
+            return wheel_pop(index);
+        }
+
+        if ((tbtick_st) (wheel_tick - tbtick) >= 0)
+        {
+            // caught up
+            break;
+        }
+
+        if (cascades == TIMER_WHEEL_CASCADES)
+        {
+            // leave the rest of the catch up to the next tick
+            *delta = -1;
+            return NULL;
+        }
+
+        // current slot is empty, advance to the next occupied slot or cascade,
+        // turns with nothing to cascade are skipped, or to tbtick whichever is
+        // first
+        wheel_clr(index);
+
+        steps = tbtick - wheel_tick;
+
+        ticks = wheel_next(steps);
+        if (ticks < steps)
+        {
+            steps = ticks;
+        }
+
+        wheel_tick += steps;
+
+        if (!(wheel_tick & TVR_MASK))
+        {
+            cascade_timer_events();
+            cascades++;
+        }
+    }
+
+#if TIMER_SLACK
+    // expire early from the next occupied near wheel slot
+    index = wheel_find(index, TVR_SIZE);
+    if ((index < TVR_SIZE) && wheel[index] && timer_event_due(wheel[index], tbtick))
+    {
+        return wheel_pop(index);
+    }
+#endif
+
+    ticks = wheel_next(TBTIMER_MAX_DELAY);
+    if (ticks > WHEEL_MAX_DELAY)
+    {
+        ticks = WHEEL_MAX_DELAY;
+    }
+
+    *delta = (ticks > TBTIMER_MAX_DELAY) ? TBTIMER_MAX_DELAY : ticks;
+
+    return NULL;
+}
+
+
+struct timer_event * peek_timer_event(void)
+{
+    uint16_t index = wheel_find(wheel_tick & TVR_MASK, TVR_SIZE);
+
+    // only the near wheel slots hold timer events of a single tick
+    return (index < TVR_SIZE) ? (wheel[index]) : (NULL);
+}
+
+#endif // TIMER_QUEUE == TIMER_QUEUE_WHEEL